@@ -0,0 +1,314 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "advisor.h"
+#include "mcts.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define ADVISOR_MAX_ROLLOUTS (1u << 20) ///< Rollouts per action before the advisor rests
+#define ADVISOR_FLUSH        64         ///< Rollouts a worker runs between adding its results
+#define ADVISOR_REDRAW_MS    100        ///< Time between redraws of the advice
+#define ADVISOR_MENU_LINES   6          ///< Lines from the first option to the prompt
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// Background threads which look ahead from the demon while the player decides
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t redraw;
+    pthread_t* threads;
+    uint32_t numThreads;
+    pthread_t display;
+    uint32_t horizon;
+    bool quit;
+
+    // The current menu, only changed with the lock held
+    bool running;
+    uint32_t generation;  ///< Incremented for every menu, so stale results are dropped
+    atomic_uint active;   ///< The generation being looked ahead from, 0 once the menu is answered
+    demon_t root;
+    uint64_t seed;
+    uint32_t column;      ///< Where the advice goes on the menu lines
+    atomic_uint nextRollout;
+    uint32_t rollouts[MCTS_NUM_ACTIONS];
+    uint32_t survived[MCTS_NUM_ACTIONS];
+    int64_t happySum[MCTS_NUM_ACTIONS];
+    uint32_t drawnRollouts; ///< Rollouts when the advice was last drawn
+} advisor_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+static advisor_t advisor;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Worker thread. Waits for a menu, then runs rollouts of each action
+ * and adds up how many survive and how happy they end up, until the menu is
+ * answered or the rollout budget is used up
+ *
+ * @param arg unused
+ * @return NULL
+ */
+static void* advisorWorker(void* arg)
+{
+    (void)arg;
+    autoMode = true;
+
+    uint32_t seenGeneration = 0;
+    pthread_mutex_lock(&advisor.lock);
+    while (true)
+    {
+        while (!advisor.quit && (!advisor.running || advisor.generation == seenGeneration))
+        {
+            pthread_cond_wait(&advisor.workReady, &advisor.lock);
+        }
+        if (advisor.quit)
+        {
+            break;
+        }
+        seenGeneration = advisor.generation;
+        demon_t root;
+        copyDemon(&root, &advisor.root);
+        uint64_t seed = advisor.seed;
+        pthread_mutex_unlock(&advisor.lock);
+
+        // Rollouts are numbered like mcts, so each action sees the same random futures
+        bool current = true;
+        while (current)
+        {
+            uint32_t rollouts[MCTS_NUM_ACTIONS] = {0};
+            uint32_t survived[MCTS_NUM_ACTIONS] = {0};
+            int64_t happySum[MCTS_NUM_ACTIONS] = {0};
+            bool exhausted = false;
+            for (int i = 0; i < ADVISOR_FLUSH && !exhausted; i++)
+            {
+                // Checked every rollout, so answering the menu frees the cores right away
+                uint32_t r = atomic_fetch_add(&advisor.nextRollout, 1);
+                exhausted = (r >= ADVISOR_MAX_ROLLOUTS * MCTS_NUM_ACTIONS) ||
+                            (atomic_load_explicit(&advisor.active, memory_order_relaxed) != seenGeneration);
+                if (!exhausted)
+                {
+                    uint32_t action = r % MCTS_NUM_ACTIONS;
+                    demon_t fork;
+                    copyDemon(&fork, &root);
+                    fork.rng = mixSeed(seed, r / MCTS_NUM_ACTIONS);
+                    stepDemon(&fork, '1' + action);
+                    runTicks(&fork, POLICY_HEURISTIC, advisor.horizon - 1);
+                    releaseDemon(&fork);
+                    rollouts[action]++;
+                    survived[action] += (fork.health > 0);
+                    happySum[action] += fork.happy;
+                }
+            }
+
+            // Only add results if the player hasn't answered this menu yet
+            pthread_mutex_lock(&advisor.lock);
+            current = advisor.running && advisor.generation == seenGeneration && !exhausted;
+            if (advisor.running && advisor.generation == seenGeneration)
+            {
+                for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+                {
+                    advisor.rollouts[a] += rollouts[a];
+                    advisor.survived[a] += survived[a];
+                    advisor.happySum[a] += happySum[a];
+                }
+            }
+            if (current)
+            {
+                pthread_mutex_unlock(&advisor.lock);
+            }
+        }
+        releaseDemon(&root);
+    }
+    pthread_mutex_unlock(&advisor.lock);
+    return NULL;
+}
+
+/**
+ * @brief Write each action's advice at the end of its menu line, then put the
+ * cursor back at the prompt. The lock must be held
+ */
+static void advisorDraw(void)
+{
+    // The best option survives most often, with ties going to the happiest
+    int best = 0;
+    double score[MCTS_NUM_ACTIONS];
+    double happy[MCTS_NUM_ACTIONS];
+    for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+    {
+        score[a] = advisor.rollouts[a] ? advisor.survived[a] / (double)advisor.rollouts[a] : 0;
+        happy[a] = advisor.rollouts[a] ? advisor.happySum[a] / (double)advisor.rollouts[a] : 0;
+        if (score[a] > score[best] || (score[a] == score[best] && happy[a] > happy[best]))
+        {
+            best = a;
+        }
+    }
+
+    // Save the cursor, go up to each option's line, and restore the cursor
+    printf("\0337");
+    for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+    {
+        if (0 == advisor.rollouts[a])
+        {
+            continue;
+        }
+        printf("\0338\033[%dA\033[%uG\033[K", ADVISOR_MENU_LINES - a, advisor.column);
+        printf("%c %3.0f%% survive %u, happy %+6.1f  (%u)", (a == best) ? '*' : ' ', 100 * score[a],
+               advisor.horizon, happy[a], advisor.rollouts[a]);
+    }
+    printf("\0338");
+    fflush(stdout);
+}
+
+/**
+ * @brief Display thread. Redraws the advice as it's refined, until the menu is
+ * answered
+ *
+ * @param arg unused
+ * @return NULL
+ */
+static void* advisorDisplay(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&advisor.lock);
+    while (!advisor.quit)
+    {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += ADVISOR_REDRAW_MS * 1000000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&advisor.redraw, &advisor.lock, &wake);
+
+        uint32_t total = 0;
+        for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+        {
+            total += advisor.rollouts[a];
+        }
+        if (advisor.running && total != advisor.drawnRollouts)
+        {
+            advisorDraw();
+            advisor.drawnRollouts = total;
+        }
+    }
+    pthread_mutex_unlock(&advisor.lock);
+    return NULL;
+}
+
+/**
+ * @brief Start the advisor's threads. Until this is called, starting and
+ * stopping the advisor does nothing
+ *
+ * @param threads The number of rollout threads
+ * @param horizon Ticks per rollout
+ */
+void advisorInit(uint32_t threads, uint32_t horizon)
+{
+    memset(&advisor, 0, sizeof(advisor));
+    pthread_mutex_init(&advisor.lock, NULL);
+    pthread_cond_init(&advisor.workReady, NULL);
+    pthread_cond_init(&advisor.redraw, NULL);
+    advisor.horizon = horizon;
+
+    advisor.numThreads = threads;
+    advisor.threads = calloc(threads, sizeof(pthread_t));
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        pthread_create(&advisor.threads[t], NULL, advisorWorker, NULL);
+    }
+    pthread_create(&advisor.display, NULL, advisorDisplay, NULL);
+}
+
+/**
+ * @brief Stop the advisor's threads, if they were started
+ */
+void advisorDeinit(void)
+{
+    if (NULL == advisor.threads)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&advisor.lock);
+    advisor.quit = true;
+    pthread_cond_broadcast(&advisor.workReady);
+    pthread_cond_broadcast(&advisor.redraw);
+    pthread_mutex_unlock(&advisor.lock);
+
+    for (uint32_t t = 0; t < advisor.numThreads; t++)
+    {
+        pthread_join(advisor.threads[t], NULL);
+    }
+    pthread_join(advisor.display, NULL);
+    free(advisor.threads);
+    advisor.threads = NULL;
+    releaseDemon(&advisor.root);
+
+    pthread_cond_destroy(&advisor.redraw);
+    pthread_cond_destroy(&advisor.workReady);
+    pthread_mutex_destroy(&advisor.lock);
+}
+
+/**
+ * @brief Start looking ahead from a demon whose menu was just printed. This
+ * doesn't wait for anything, so the menu shows as fast as without the advisor
+ *
+ * @param pd The demon
+ */
+void advisorStart(const demon_t* pd)
+{
+    if (NULL == advisor.threads)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&advisor.lock);
+    releaseDemon(&advisor.root);
+    copyDemon(&advisor.root, pd);
+    advisor.seed = mixSeed(pd->rng, advisor.generation);
+    advisor.column = strlen("  4. Give medicine to ") + strlen(demonName(pd)) + 3;
+    atomic_store(&advisor.nextRollout, 0);
+    memset(advisor.rollouts, 0, sizeof(advisor.rollouts));
+    memset(advisor.survived, 0, sizeof(advisor.survived));
+    memset(advisor.happySum, 0, sizeof(advisor.happySum));
+    advisor.drawnRollouts = 0;
+    advisor.generation = advisor.generation + 1 ? advisor.generation + 1 : 1;
+    atomic_store(&advisor.active, advisor.generation);
+    advisor.running = true;
+    pthread_cond_broadcast(&advisor.workReady);
+    pthread_mutex_unlock(&advisor.lock);
+}
+
+/**
+ * @brief Cancel the look ahead because the player answered. Workers drop what
+ * they're running and nothing more is drawn once this returns, but it never
+ * waits for a rollout to finish
+ */
+void advisorStop(void)
+{
+    if (NULL == advisor.threads)
+    {
+        return;
+    }
+
+    atomic_store(&advisor.active, 0);
+    pthread_mutex_lock(&advisor.lock);
+    advisor.running = false;
+    pthread_mutex_unlock(&advisor.lock);
+}
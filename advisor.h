@@ -0,0 +1,19 @@
+#ifndef _ADVISOR_H_
+#define _ADVISOR_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void advisorInit(uint32_t threads, uint32_t horizon);
+void advisorDeinit(void);
+void advisorStart(const demon_t* pd);
+void advisorStop(void);
+
+#endif
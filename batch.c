@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "batch.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define BATCH_CHUNK 256 ///< Lifetimes a worker claims at a time
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// A batch of lifetimes shared out between worker threads
+typedef struct
+{
+    batchStats_t* stats;   ///< Where every worker's stats are merged
+    pthread_mutex_t lock;  ///< Guards stats
+    atomic_uint nextChunk;
+    atomic_uint nextSlot;   ///< The next live stats slot to hand to a worker
+    liveShared_t* live;     ///< Where workers publish running totals, NULL for none
+    colWriter_t* columns;   ///< Where workers write every lifetime's row, NULL for none
+    uint32_t config;        ///< configId(), for the rows
+    uint32_t first;
+    uint32_t numLifetimes;
+    policy_t policy;
+    bool specialized;
+    uint64_t seed;
+} batchJob_t;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Batch worker thread. Claims chunks of lifetimes until there are none
+ * left, then merges its stats into the batch's
+ *
+ * @param arg The batchJob_t
+ * @return NULL
+ */
+static void* batchWorker(void* arg)
+{
+    batchJob_t* job = arg;
+    autoMode = true;
+
+    batchStats_t* stats = malloc(sizeof(batchStats_t));
+    statsInit(stats);
+    liveSlot_t* slot = (NULL == job->live) ? NULL : &job->live->slots[atomic_fetch_add(&job->nextSlot, 1)];
+    liveTotals_t slotBase;
+    if (NULL != slot)
+    {
+        liveReadSlot(slot, &slotBase);
+    }
+    colBuffer_t* rows = (NULL == job->columns) ? NULL : colBufferNew(job->columns);
+
+    uint32_t chunk;
+    while ((chunk = atomic_fetch_add(&job->nextChunk, 1)) < (job->numLifetimes + BATCH_CHUNK - 1) / BATCH_CHUNK)
+    {
+        uint32_t end = (chunk + 1) * BATCH_CHUNK;
+        if (end > job->numLifetimes)
+        {
+            end = job->numLifetimes;
+        }
+        for (uint32_t i = chunk * BATCH_CHUNK; i < end; i++)
+        {
+            // Seeds come from the lifetime's index in the whole run, so shards and threads don't change results
+            demon_t pd;
+            uint64_t seed = mixSeed(job->seed, job->first + i);
+            memset(evtCtr, 0, sizeof(evtCtr));
+            resetDemon(&pd, seed);
+            if (job->specialized)
+            {
+                runLifetime(&pd, job->policy);
+            }
+            else
+            {
+                runLifetimeGeneric(&pd);
+            }
+            statsAddDemon(stats, &pd);
+            statsAddEvents(stats, evtCtr);
+            if (NULL != slot)
+            {
+                livePublish(slot, &slotBase, stats->lifetimes, stats->sum, stats->evtCount);
+            }
+            if (NULL != rows)
+            {
+                colBufferAdd(rows, job->first + i, seed, job->policy, job->config, &pd);
+            }
+        }
+    }
+    colBufferFree(rows);
+
+    pthread_mutex_lock(&job->lock);
+    statsMerge(job->stats, stats);
+    pthread_mutex_unlock(&job->lock);
+    free(stats);
+    return NULL;
+}
+
+/**
+ * @brief Simulate a batch of demon lifetimes in auto mode on worker threads.
+ * The stats are integers, so they don't depend on the number of threads
+ *
+ * @param stats        Where to add the dead demons' stats
+ * @param first        The index of the first lifetime in the whole run
+ * @param numLifetimes The number of demons to simulate
+ * @param policy       The policy picking actions
+ * @param specialized  true to use the stage kernels, false for the generic loop
+ * @param seed         The base seed, each lifetime gets its own stream of it
+ * @param threads      The number of worker threads
+ * @param live         Where to publish running totals, with a slot per thread, or NULL
+ * @param columns      Where to write every lifetime's row, or NULL
+ */
+void runBatch(batchStats_t* stats, uint32_t first, uint32_t numLifetimes, policy_t policy, bool specialized,
+              uint64_t seed, uint32_t threads, liveShared_t* live,
+              colWriter_t* columns)
+{
+    autoPolicy = policy;
+
+    batchJob_t job =
+    {
+        .stats = stats,
+        .first = first,
+        .numLifetimes = numLifetimes,
+        .policy = policy,
+        .specialized = specialized,
+        .seed = seed,
+        .live = live,
+        .columns = columns,
+        .config = configId(),
+    };
+    pthread_mutex_init(&job.lock, NULL);
+    atomic_init(&job.nextChunk, 0);
+    atomic_init(&job.nextSlot, 0);
+
+    pthread_t* workers = calloc(threads, sizeof(pthread_t));
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        pthread_create(&workers[t], NULL, batchWorker, &job);
+    }
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    pthread_mutex_destroy(&job.lock);
+}
@@ -0,0 +1,21 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+#include "columns.h"
+#include "live.h"
+#include "stats.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void runBatch(batchStats_t* stats, uint32_t first, uint32_t numLifetimes, policy_t policy, bool specialized,
+              uint64_t seed, uint32_t threads, liveShared_t* live,
+              colWriter_t* columns);
+
+#endif
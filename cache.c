@@ -0,0 +1,248 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "qlearn.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define CACHE_PATH_LEN 4096
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// Everything that decides a range of lifetimes' results, hashed for its cache key
+typedef struct
+{
+    uint32_t config;    ///< configId(), the game constants and SIM_VERSION
+    uint32_t policy;
+    uint32_t seed;
+    uint32_t first;
+    uint32_t count;
+    uint32_t rollouts;  ///< mcts only
+    uint32_t horizon;   ///< mcts only
+    uint32_t pad;
+    uint64_t qtable;    ///< qtable only, the table's hash
+} cacheKeyFields_t;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Get the cache key of a range of lifetimes (FNV-1a)
+ *
+ * @param opts  The command line options
+ * @param first The range's first lifetime
+ * @param count The range's lifetimes
+ * @return The key
+ */
+static uint64_t cacheKey(const options_t* opts, uint32_t first, uint32_t count)
+{
+    // Zeroed so padding and other policies' fields don't change the key
+    cacheKeyFields_t fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.config = configId();
+    fields.policy = opts->policy;
+    fields.seed = opts->seed;
+    fields.first = first;
+    fields.count = count;
+    if (POLICY_MCTS == opts->policy)
+    {
+        fields.rollouts = opts->rollouts;
+        fields.horizon = opts->horizon;
+    }
+    else if (POLICY_QTABLE == opts->policy)
+    {
+        fields.qtable = qtableHash();
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = (const uint8_t*)&fields;
+    for (size_t i = 0; i < sizeof(fields); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Get the path of a cache entry
+ *
+ * @param plan The plan, for the directory
+ * @param key  The entry's key
+ * @param path Where to store the path, CACHE_PATH_LEN long
+ */
+static void cachePath(const cachePlan_t* plan, uint64_t key, char* path)
+{
+    snprintf(path, CACHE_PATH_LEN, "%s/%016llx.dres", plan->dir, (unsigned long long)key);
+}
+
+/**
+ * @brief Split a run's lifetimes into cache units and merge the ones already
+ * in the cache. Units are aligned to CACHE_UNIT_LIFETIMES in the lifetime
+ * index, so runs which overlap, like a longer run or another shard split,
+ * share them
+ *
+ * @param plan      Where to store which units hit and missed
+ * @param opts      The command line options, with the cache directory
+ * @param first     The run's first lifetime
+ * @param count     The run's lifetimes
+ * @param readCache false to treat every unit as a miss, e.g. when each
+ *                  lifetime's row is needed
+ * @param stats     Where to merge the stats of units which hit
+ * @return false if the run can't be cached, then every unit is a miss and
+ * nothing is stored
+ */
+bool cacheLookup(cachePlan_t* plan, const options_t* opts, uint32_t first, uint32_t count, bool readCache,
+                 batchStats_t* stats)
+{
+    memset(plan, 0, sizeof(*plan));
+    plan->dir = opts->cacheDir;
+    uint32_t numUnits = (count + CACHE_UNIT_LIFETIMES - 1) / CACHE_UNIT_LIFETIMES + 1;
+    plan->misses = calloc(numUnits, sizeof(cacheUnit_t));
+
+    // Lookahead with a time limit depends on how fast the machine is
+    bool cacheable = true;
+    if (POLICY_MCTS == opts->policy && opts->decisionMs > 0)
+    {
+        printf("mcts with -T depends on the machine's speed, not caching\n");
+        cacheable = false;
+    }
+    else if (0 != mkdir(plan->dir, 0755) && EEXIST != errno)
+    {
+        printf("Couldn't create the cache directory %s, not caching\n", plan->dir);
+        cacheable = false;
+    }
+    if (!cacheable)
+    {
+        plan->dir = NULL;
+        plan->misses[plan->numMisses++] = (cacheUnit_t){.first = first, .count = count};
+        plan->missLifetimes = count;
+        return false;
+    }
+
+    batchStats_t* unitStats = malloc(sizeof(batchStats_t));
+    uint32_t end = first + count;
+    for (uint32_t unitFirst = first; unitFirst < end;)
+    {
+        uint32_t unitEnd = (unitFirst / CACHE_UNIT_LIFETIMES + 1) * CACHE_UNIT_LIFETIMES;
+        unitEnd = (unitEnd > end || unitEnd < unitFirst) ? end : unitEnd;
+        cacheUnit_t unit = {.first = unitFirst, .count = unitEnd - unitFirst};
+        unit.key = cacheKey(opts, unit.first, unit.count);
+
+        // The entry's own shard info must match too, in case of a collision or a stray file
+        char path[CACHE_PATH_LEN];
+        shardInfo_t shard;
+        cachePath(plan, unit.key, path);
+        if (readCache && readResultFile(path, &shard, unitStats) && configId() == shard.config &&
+            opts->policy == shard.policy && opts->seed == shard.seed && unit.first == shard.first &&
+            unit.count == shard.count && unit.count == unitStats->lifetimes)
+        {
+            statsMerge(stats, unitStats);
+            plan->hits++;
+            plan->hitLifetimes += unit.count;
+        }
+        else
+        {
+            plan->misses[plan->numMisses++] = unit;
+            plan->missLifetimes += unit.count;
+        }
+        unitFirst = unitEnd;
+    }
+    free(unitStats);
+    return true;
+}
+
+/**
+ * @brief Simulate the units the cache missed, merge them into the run's stats
+ * and store them in the cache
+ *
+ * @param plan    The plan from cacheLookup()
+ * @param opts    The command line options
+ * @param stats   Where to merge the simulated units' stats
+ * @param threads The number of worker threads
+ * @param live    Where to publish running totals, or NULL
+ * @param columns Where to write every simulated lifetime's row, or NULL
+ */
+void cacheRun(cachePlan_t* plan, const options_t* opts, batchStats_t* stats, uint32_t threads,
+              liveShared_t* live, colWriter_t* columns)
+{
+    batchStats_t* unitStats = malloc(sizeof(batchStats_t));
+    for (uint32_t m = 0; m < plan->numMisses; m++)
+    {
+        const cacheUnit_t* unit = &plan->misses[m];
+        statsInit(unitStats);
+        runBatch(unitStats, unit->first, unit->count, opts->policy, true, opts->seed, threads, live, columns);
+        statsMerge(stats, unitStats);
+        if (NULL == plan->dir)
+        {
+            continue;
+        }
+
+        // Write then rename, so a concurrent run never reads half an entry
+        shardInfo_t shard =
+        {
+            .policy = opts->policy,
+            .seed = opts->seed,
+            .totalLifetimes = unit->count,
+            .shardIndex = 0,
+            .shardCount = 1,
+            .first = unit->first,
+            .count = unit->count,
+            .config = configId(),
+        };
+        char path[CACHE_PATH_LEN];
+        char tmpPath[CACHE_PATH_LEN + 32];
+        cachePath(plan, unit->key, path);
+        snprintf(tmpPath, sizeof(tmpPath), "%s.%d.tmp", path, (int)getpid());
+        if (writeResultFile(tmpPath, &shard, unitStats) && 0 == rename(tmpPath, path))
+        {
+            plan->written++;
+        }
+        else
+        {
+            remove(tmpPath);
+        }
+    }
+    free(unitStats);
+}
+
+/**
+ * @brief Print how much of a run the cache saved
+ *
+ * @param plan The plan, after cacheRun()
+ */
+void cacheReport(const cachePlan_t* plan)
+{
+    if (NULL == plan->dir)
+    {
+        printf("cache: not used, every lifetime was simulated\n");
+        return;
+    }
+    uint64_t total = plan->hitLifetimes + plan->missLifetimes;
+    printf("cache %s: %u of %u units hit (%llu lifetimes, %.1f%%), %u missed (%llu lifetimes simulated), "
+           "%u stored\n", plan->dir, plan->hits, plan->hits + plan->numMisses,
+           (unsigned long long)plan->hitLifetimes, total ? 100.0 * plan->hitLifetimes / total : 0,
+           plan->numMisses, (unsigned long long)plan->missLifetimes, plan->written);
+}
+
+/**
+ * @brief Free a plan
+ *
+ * @param plan The plan
+ */
+void cacheFree(cachePlan_t* plan)
+{
+    free(plan->misses);
+    plan->misses = NULL;
+}
@@ -0,0 +1,52 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+#include "batch.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define CACHE_UNIT_LIFETIMES 65536 ///< Lifetimes per cached result, aligned to the lifetime index
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// A range of lifetimes with its own cache entry
+typedef struct
+{
+    uint32_t first;
+    uint32_t count;
+    uint64_t key; ///< Hash of everything that decides the range's results
+} cacheUnit_t;
+
+/// Which units of a run the cache has, and which still need simulating
+typedef struct
+{
+    const char* dir;
+    cacheUnit_t* misses;
+    uint32_t numMisses;
+    uint32_t hits;
+    uint64_t hitLifetimes;
+    uint64_t missLifetimes;
+    uint32_t written;        ///< Misses stored after simulating them
+} cachePlan_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+bool cacheLookup(cachePlan_t* plan, const options_t* opts, uint32_t first, uint32_t count, bool readCache,
+                 batchStats_t* stats);
+void cacheRun(cachePlan_t* plan, const options_t* opts, batchStats_t* stats, uint32_t threads,
+              liveShared_t* live, colWriter_t* columns);
+void cacheReport(const cachePlan_t* plan);
+void cacheFree(cachePlan_t* plan);
+
+#endif
@@ -0,0 +1,784 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "columns.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define COL_FILE_MAGIC   0x4C4F4344 ///< "DCOL"
+#define COL_FILE_VERSION 1
+
+#define COL_MAX_FILTERS 16
+
+// A chunk is two header words, the encoding and bit width then the base value,
+// followed by every row's value packed into that many bits
+#define COL_CHUNK_HEADER_WORDS 2
+#define COL_MAX_CHUNK_WORDS    (COL_CHUNK_HEADER_WORDS + COL_BLOCK_ROWS)
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+typedef enum
+{
+    COL_ENC_FOR,   ///< Frame of reference, each value minus the smallest
+    COL_ENC_DELTA, ///< Zigzagged differences from the previous value, for sorted-ish columns
+    COL_NUM_ENCODINGS,
+} colEncoding_t;
+
+typedef enum
+{
+    COL_OP_LT,
+    COL_OP_LE,
+    COL_OP_GT,
+    COL_OP_GE,
+    COL_OP_EQ,
+    COL_OP_NE,
+    COL_NUM_OPS,
+} colOp_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// The start of the footer. The block index follows it, then the footer's offset
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numColumns;
+    uint32_t numBlocks;
+    uint64_t rows;
+} colFooter_t;
+
+/// A query's row filter, column op value
+typedef struct
+{
+    column_t column;
+    colOp_t op;
+    int64_t value;
+} colFilter_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+static const char* colNames[COL_NUM_COLUMNS] =
+{
+    "lifetime",
+    "seed",
+    "policy",
+    "config",
+    "hunger",
+    "happy",
+    "discipline",
+    "health",
+    "poopCount",
+    "actionsTaken",
+    "age",
+    "isSick",
+};
+
+static const char* colOpNames[COL_NUM_OPS] =
+{
+    [COL_OP_LE] = "<=",
+    [COL_OP_GE] = ">=",
+    [COL_OP_EQ] = "==",
+    [COL_OP_NE] = "!=",
+    [COL_OP_LT] = "<",
+    [COL_OP_GT] = ">",
+};
+// Longest first, so <= isn't parsed as <
+static const colOp_t colOpParseOrder[COL_NUM_OPS] =
+{
+    COL_OP_LE, COL_OP_GE, COL_OP_EQ, COL_OP_NE, COL_OP_LT, COL_OP_GT,
+};
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Get the bits needed to hold a value
+ *
+ * @param x The value
+ * @return 0 to 64
+ */
+static uint32_t colBits(uint64_t x)
+{
+    return x ? 64 - __builtin_clzll(x) : 0;
+}
+
+/**
+ * @brief Get the mask of a bit width
+ *
+ * @param bits 0 to 64
+ * @return The mask
+ */
+static uint64_t colMask(uint32_t bits)
+{
+    return (bits >= 64) ? UINT64_MAX : ((1ull << bits) - 1);
+}
+
+/**
+ * @brief Encode one column's values of a block as a chunk, picking whichever
+ * encoding packs smaller
+ *
+ * @param values The values
+ * @param rows   The number of values
+ * @param out    Where to write the chunk, COL_MAX_CHUNK_WORDS long
+ * @param entry  Where to store the chunk's size, min and max
+ * @return The chunk's size in words
+ */
+static uint32_t colEncode(const int64_t* values, uint32_t rows, uint64_t* out, colChunkEntry_t* entry)
+{
+    int64_t min = values[0];
+    int64_t max = values[0];
+    uint64_t maxZigzag = 0;
+    for (uint32_t i = 1; i < rows; i++)
+    {
+        min = (values[i] < min) ? values[i] : min;
+        max = (values[i] > max) ? values[i] : max;
+        int64_t delta = (int64_t)((uint64_t)values[i] - (uint64_t)values[i - 1]);
+        uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        maxZigzag = (zigzag > maxZigzag) ? zigzag : maxZigzag;
+    }
+    entry->min = min;
+    entry->max = max;
+
+    uint32_t forBits = colBits((uint64_t)max - (uint64_t)min);
+    uint32_t deltaBits = colBits(maxZigzag);
+    colEncoding_t enc = (deltaBits < forBits) ? COL_ENC_DELTA : COL_ENC_FOR;
+    uint32_t bits = (COL_ENC_DELTA == enc) ? deltaBits : forBits;
+    uint32_t words = ((uint64_t)rows * bits + 63) / 64;
+
+    out[0] = enc | (bits << 8);
+    out[1] = (COL_ENC_DELTA == enc) ? (uint64_t)values[0] : (uint64_t)min;
+    uint64_t* packed = &out[COL_CHUNK_HEADER_WORDS];
+    memset(packed, 0, words * sizeof(uint64_t));
+    for (uint32_t i = 0; i < rows && bits > 0; i++)
+    {
+        uint64_t v;
+        if (COL_ENC_DELTA == enc)
+        {
+            int64_t delta = i ? (int64_t)((uint64_t)values[i] - (uint64_t)values[i - 1]) : 0;
+            v = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+        }
+        else
+        {
+            v = (uint64_t)values[i] - (uint64_t)min;
+        }
+        uint64_t pos = (uint64_t)i * bits;
+        uint32_t off = pos % 64;
+        packed[pos / 64] |= v << off;
+        if (off + bits > 64)
+        {
+            packed[pos / 64 + 1] |= v >> (64 - off);
+        }
+    }
+    return COL_CHUNK_HEADER_WORDS + words;
+}
+
+/**
+ * @brief Decode a chunk
+ *
+ * @param chunk  The chunk
+ * @param rows   The number of values in it
+ * @param values Where to store the values
+ */
+static void colDecode(const uint64_t* chunk, uint32_t rows, int64_t* values)
+{
+    colEncoding_t enc = chunk[0] & 0xFF;
+    uint32_t bits = (chunk[0] >> 8) & 0xFF;
+    uint64_t base = chunk[1];
+    uint64_t mask = colMask(bits);
+    const uint64_t* packed = &chunk[COL_CHUNK_HEADER_WORDS];
+
+    uint64_t prev = base;
+    for (uint32_t i = 0; i < rows; i++)
+    {
+        uint64_t v = 0;
+        if (bits > 0)
+        {
+            uint64_t pos = (uint64_t)i * bits;
+            uint32_t off = pos % 64;
+            v = packed[pos / 64] >> off;
+            if (off + bits > 64)
+            {
+                v |= packed[pos / 64 + 1] << (64 - off);
+            }
+            v &= mask;
+        }
+        if (COL_ENC_DELTA == enc)
+        {
+            prev += (v >> 1) ^ (0 - (v & 1));
+            values[i] = (int64_t)prev;
+        }
+        else
+        {
+            values[i] = (int64_t)(base + v);
+        }
+    }
+}
+
+/**
+ * @brief Check that a chunk lies inside the data part of a mapped file and
+ * holds as many values as its block says, so decoding it stays in bounds
+ *
+ * @param file    The mapped file
+ * @param dataEnd Where the chunks end, the footer's offset
+ * @param chunk   The chunk's index entry
+ * @param rows    The number of values in the chunk
+ * @return true if it's safe to decode
+ */
+static bool colChunkValid(const uint8_t* file, uint64_t dataEnd, const colChunkEntry_t* chunk, uint32_t rows)
+{
+    uint64_t headerBytes = COL_CHUNK_HEADER_WORDS * sizeof(uint64_t);
+    if (0 != chunk->offset % sizeof(uint64_t) || chunk->size < headerBytes || chunk->offset > dataEnd ||
+        chunk->size > dataEnd - chunk->offset)
+    {
+        return false;
+    }
+    uint64_t header;
+    memcpy(&header, &file[chunk->offset], sizeof(header));
+    uint32_t bits = (header >> 8) & 0xFF;
+    uint64_t packedBytes = ((uint64_t)rows * bits + 63) / 64 * sizeof(uint64_t);
+    return (header & 0xFF) < COL_NUM_ENCODINGS && bits <= 64 && headerBytes + packedBytes <= chunk->size;
+}
+
+/**
+ * @brief Open a per-lifetime results file for writing
+ *
+ * @param path The file
+ * @return The writer, NULL if the file couldn't be opened
+ */
+colWriter_t* colWriterOpen(const char* path)
+{
+    FILE* fp = fopen(path, "wb");
+    if (NULL == fp)
+    {
+        return NULL;
+    }
+    uint32_t header[2] = {COL_FILE_MAGIC, COL_FILE_VERSION};
+    colWriter_t* writer = calloc(1, sizeof(colWriter_t));
+    writer->fp = fp;
+    writer->offset = sizeof(header);
+    writer->failed = (1 != fwrite(header, sizeof(header), 1, fp));
+    pthread_mutex_init(&writer->lock, NULL);
+    return writer;
+}
+
+/**
+ * @brief Write the footer index and close a per-lifetime results file. Every
+ * worker's buffer must already be freed
+ *
+ * @param writer The writer, may be NULL
+ * @return true if the whole file was written
+ */
+bool colWriterClose(colWriter_t* writer)
+{
+    if (NULL == writer)
+    {
+        return true;
+    }
+    colFooter_t footer =
+    {
+        .magic = COL_FILE_MAGIC,
+        .version = COL_FILE_VERSION,
+        .numColumns = COL_NUM_COLUMNS,
+        .numBlocks = writer->numBlocks,
+        .rows = writer->rows,
+    };
+    bool ok = !writer->failed &&
+              1 == fwrite(&footer, sizeof(footer), 1, writer->fp) &&
+              writer->numBlocks == fwrite(writer->blocks, sizeof(colBlockEntry_t), writer->numBlocks, writer->fp) &&
+              1 == fwrite(&writer->offset, sizeof(writer->offset), 1, writer->fp);
+    ok = (0 == fclose(writer->fp)) && ok;
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->blocks);
+    free(writer);
+    return ok;
+}
+
+/**
+ * @brief Make a worker's buffer of rows for a results file
+ *
+ * @param writer The file
+ * @return The buffer
+ */
+colBuffer_t* colBufferNew(colWriter_t* writer)
+{
+    colBuffer_t* buf = malloc(sizeof(colBuffer_t));
+    buf->writer = writer;
+    buf->rows = 0;
+    buf->scratch = malloc(COL_NUM_COLUMNS * COL_MAX_CHUNK_WORDS * sizeof(uint64_t));
+    return buf;
+}
+
+/**
+ * @brief Encode a buffer's rows as a block and append it to the file. Only the
+ * append holds the writer's lock
+ *
+ * @param buf The buffer
+ */
+static void colBufferFlush(colBuffer_t* buf)
+{
+    if (0 == buf->rows)
+    {
+        return;
+    }
+    colBlockEntry_t block = {.rows = buf->rows};
+    uint32_t words = 0;
+    for (int c = 0; c < COL_NUM_COLUMNS; c++)
+    {
+        uint32_t chunkWords = colEncode(buf->values[c], buf->rows, &buf->scratch[words], &block.chunks[c]);
+        block.chunks[c].offset = words * sizeof(uint64_t);
+        block.chunks[c].size = chunkWords * sizeof(uint64_t);
+        words += chunkWords;
+    }
+
+    colWriter_t* writer = buf->writer;
+    pthread_mutex_lock(&writer->lock);
+    for (int c = 0; c < COL_NUM_COLUMNS; c++)
+    {
+        block.chunks[c].offset += writer->offset;
+    }
+    if (writer->numBlocks == writer->capBlocks)
+    {
+        writer->capBlocks = writer->capBlocks ? writer->capBlocks * 2 : 64;
+        writer->blocks = realloc(writer->blocks, writer->capBlocks * sizeof(colBlockEntry_t));
+    }
+    writer->blocks[writer->numBlocks++] = block;
+    writer->failed |= (words != fwrite(buf->scratch, sizeof(uint64_t), words, writer->fp));
+    writer->offset += words * sizeof(uint64_t);
+    writer->rows += buf->rows;
+    pthread_mutex_unlock(&writer->lock);
+
+    buf->rows = 0;
+}
+
+/**
+ * @brief Add a dead demon's row to a worker's buffer, writing a block when
+ * it's full
+ *
+ * @param buf      The buffer
+ * @param lifetime The lifetime's index in the whole run
+ * @param seed     The lifetime's seed
+ * @param policy   The policy that picked its actions
+ * @param config   configId() of the simulator
+ * @param pd       The demon
+ */
+void colBufferAdd(colBuffer_t* buf, uint32_t lifetime, uint64_t seed, policy_t policy, uint32_t config,
+                  const demon_t* pd)
+{
+    uint32_t r = buf->rows;
+    buf->values[COL_LIFETIME][r] = lifetime;
+    buf->values[COL_SEED][r] = (int64_t)seed;
+    buf->values[COL_POLICY][r] = policy;
+    buf->values[COL_CONFIG][r] = config;
+    buf->values[COL_HUNGER][r] = pd->hunger;
+    buf->values[COL_HAPPY][r] = pd->happy;
+    buf->values[COL_DISCIPLINE][r] = pd->discipline;
+    buf->values[COL_HEALTH][r] = pd->health;
+    buf->values[COL_POOP_COUNT][r] = pd->poopCount;
+    buf->values[COL_ACTIONS_TAKEN][r] = pd->actionsTaken;
+    buf->values[COL_AGE][r] = pd->age;
+    buf->values[COL_IS_SICK][r] = pd->isSick;
+    if (++buf->rows == COL_BLOCK_ROWS)
+    {
+        colBufferFlush(buf);
+    }
+}
+
+/**
+ * @brief Write a worker's remaining rows and free its buffer
+ *
+ * @param buf The buffer, may be NULL
+ */
+void colBufferFree(colBuffer_t* buf)
+{
+    if (NULL == buf)
+    {
+        return;
+    }
+    colBufferFlush(buf);
+    free(buf->scratch);
+    free(buf);
+}
+
+/**
+ * @brief Find a column by name
+ *
+ * @param name The name, which needn't be terminated
+ * @param len  The name's length
+ * @return The column, COL_NUM_COLUMNS if there's no such column
+ */
+static column_t colFind(const char* name, size_t len)
+{
+    for (int c = 0; c < COL_NUM_COLUMNS; c++)
+    {
+        if (strlen(colNames[c]) == len && 0 == strncmp(name, colNames[c], len))
+        {
+            return c;
+        }
+    }
+    return COL_NUM_COLUMNS;
+}
+
+/**
+ * @brief Parse a filter like actionsTaken>=200
+ *
+ * @param expr   The filter
+ * @param filter Where to store it
+ * @return true if it was valid
+ */
+static bool colParseFilter(const char* expr, colFilter_t* filter)
+{
+    size_t nameLen = strcspn(expr, "<>=!");
+    filter->column = colFind(expr, nameLen);
+    if (COL_NUM_COLUMNS == filter->column)
+    {
+        return false;
+    }
+    const char* op = &expr[nameLen];
+    for (int o = 0; o < COL_NUM_OPS; o++)
+    {
+        colOp_t candidate = colOpParseOrder[o];
+        size_t opLen = strlen(colOpNames[candidate]);
+        if (0 == strncmp(op, colOpNames[candidate], opLen))
+        {
+            char* end;
+            filter->op = candidate;
+            filter->value = strtoll(op + opLen, &end, 0);
+            return end != op + opLen && '\0' == *end;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check a value against a filter
+ *
+ * @param filter The filter
+ * @param v      The value
+ * @return true if it passes
+ */
+static bool colFilterPasses(const colFilter_t* filter, int64_t v)
+{
+    switch (filter->op)
+    {
+        case COL_OP_LT:
+        {
+            return v < filter->value;
+        }
+        case COL_OP_LE:
+        {
+            return v <= filter->value;
+        }
+        case COL_OP_GT:
+        {
+            return v > filter->value;
+        }
+        case COL_OP_GE:
+        {
+            return v >= filter->value;
+        }
+        case COL_OP_EQ:
+        {
+            return v == filter->value;
+        }
+        default:
+        case COL_OP_NE:
+        {
+            return v != filter->value;
+        }
+    }
+}
+
+/**
+ * @brief Check if any value in a chunk's range could pass a filter
+ *
+ * @param filter The filter
+ * @param chunk  The chunk's index entry
+ * @return false if no row of the block can pass
+ */
+static bool colFilterMayPass(const colFilter_t* filter, const colChunkEntry_t* chunk)
+{
+    switch (filter->op)
+    {
+        case COL_OP_EQ:
+        {
+            return chunk->min <= filter->value && filter->value <= chunk->max;
+        }
+        case COL_OP_NE:
+        {
+            return !(chunk->min == filter->value && chunk->max == filter->value);
+        }
+        case COL_OP_LT:
+        case COL_OP_LE:
+        {
+            return colFilterPasses(filter, chunk->min);
+        }
+        default:
+        case COL_OP_GT:
+        case COL_OP_GE:
+        {
+            return colFilterPasses(filter, chunk->max);
+        }
+    }
+}
+
+/**
+ * @brief Check if every value in a chunk's range passes a filter
+ *
+ * @param filter The filter
+ * @param chunk  The chunk's index entry
+ * @return true if every row of the block passes
+ */
+static bool colFilterAllPass(const colFilter_t* filter, const colChunkEntry_t* chunk)
+{
+    switch (filter->op)
+    {
+        case COL_OP_EQ:
+        {
+            return chunk->min == filter->value && chunk->max == filter->value;
+        }
+        case COL_OP_NE:
+        {
+            return filter->value < chunk->min || chunk->max < filter->value;
+        }
+        case COL_OP_LT:
+        case COL_OP_LE:
+        {
+            return colFilterPasses(filter, chunk->max);
+        }
+        default:
+        case COL_OP_GT:
+        case COL_OP_GE:
+        {
+            return colFilterPasses(filter, chunk->min);
+        }
+    }
+}
+
+/**
+ * @brief Filter and aggregate columns of a per-lifetime results file. The file
+ * is memory mapped and only the chunks a block needs are decoded. Blocks whose
+ * min and max rule out a filter are skipped without being read
+ *
+ * @param args    The file, then any -w filters like actionsTaken>=200, then
+ *                the columns to aggregate, all but lifetime and seed by default
+ * @param numArgs The number of arguments
+ * @return 0 on success, 1 for bad arguments or a bad file
+ */
+int runQuery(char** args, int numArgs)
+{
+    colFilter_t filters[COL_MAX_FILTERS];
+    int numFilters = 0;
+    bool aggregate[COL_NUM_COLUMNS] = {false};
+    bool anyAggregate = false;
+    for (int i = 1; i < numArgs; i++)
+    {
+        if (0 == strcmp(args[i], "-w") && i + 1 < numArgs && numFilters < COL_MAX_FILTERS)
+        {
+            if (!colParseFilter(args[++i], &filters[numFilters++]))
+            {
+                printf("Bad filter %s\n", args[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            column_t c = colFind(args[i], strlen(args[i]));
+            if (COL_NUM_COLUMNS == c)
+            {
+                printf("No column %s\n", args[i]);
+                return 1;
+            }
+            aggregate[c] = true;
+            anyAggregate = true;
+        }
+    }
+    if (numArgs < 1)
+    {
+        printf("Query needs a per-lifetime results file\n");
+        return 1;
+    }
+    for (int c = COL_POLICY; c < COL_NUM_COLUMNS && !anyAggregate; c++)
+    {
+        aggregate[c] = true;
+    }
+
+    // Map the file and find the footer from its last word
+    int fd = open(args[0], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || 0 != fstat(fd, &st) || st.st_size < (off_t)(2 * sizeof(uint32_t) + sizeof(colFooter_t) +
+                                                                 sizeof(uint64_t)))
+    {
+        printf("Couldn't read %s\n", args[0]);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    const uint8_t* file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == file)
+    {
+        printf("Couldn't map %s\n", args[0]);
+        return 1;
+    }
+    // The offset is untrusted, so it's range checked before the footer is touched.
+    // The block index fills the rest of the file up to the offset word
+    uint64_t footerOffset;
+    memcpy(&footerOffset, &file[st.st_size - sizeof(uint64_t)], sizeof(footerOffset));
+    uint64_t footerEnd = st.st_size - sizeof(uint64_t) - sizeof(colFooter_t);
+    const colFooter_t* footer = NULL;
+    if (0 == footerOffset % sizeof(uint64_t) && footerOffset <= footerEnd)
+    {
+        footer = (const colFooter_t*)&file[footerOffset];
+    }
+    uint64_t indexBytes = (NULL != footer) ? footerEnd - footerOffset : 0;
+    if (NULL == footer || COL_FILE_MAGIC != footer->magic || COL_FILE_VERSION != footer->version ||
+        COL_NUM_COLUMNS != footer->numColumns || footer->numBlocks > indexBytes / sizeof(colBlockEntry_t) ||
+        footer->numBlocks * sizeof(colBlockEntry_t) != indexBytes)
+    {
+        printf("%s isn't a per-lifetime results file\n", args[0]);
+        munmap((void*)file, st.st_size);
+        return 1;
+    }
+    const colBlockEntry_t* blocks = (const colBlockEntry_t*)(footer + 1);
+
+    // A truncated or corrupt file mustn't send the decoder past the mapping
+    for (uint32_t b = 0; b < footer->numBlocks; b++)
+    {
+        bool valid = blocks[b].rows <= COL_BLOCK_ROWS;
+        for (int c = 0; c < COL_NUM_COLUMNS && valid; c++)
+        {
+            valid = colChunkValid(file, footerOffset, &blocks[b].chunks[c], blocks[b].rows);
+        }
+        if (!valid)
+        {
+            printf("%s is corrupt, block %u is out of bounds\n", args[0], b);
+            munmap((void*)file, st.st_size);
+            return 1;
+        }
+    }
+
+    double start = nowSeconds();
+    int64_t (*values)[COL_BLOCK_ROWS] = malloc(COL_NUM_COLUMNS * sizeof(*values));
+    bool* pass = malloc(COL_BLOCK_ROWS * sizeof(bool));
+    uint64_t matches = 0;
+    uint64_t blocksSkipped = 0;
+    uint64_t bytesRead = 0;
+    int64_t min[COL_NUM_COLUMNS];
+    int64_t max[COL_NUM_COLUMNS];
+
+    // Sums are of each value minus the column's first one, so the variance of
+    // columns with big values like config doesn't cancel away
+    int64_t ref[COL_NUM_COLUMNS];
+    double sum[COL_NUM_COLUMNS] = {0};
+    double sumSq[COL_NUM_COLUMNS] = {0};
+    for (uint32_t b = 0; b < footer->numBlocks; b++)
+    {
+        const colBlockEntry_t* block = &blocks[b];
+
+        // Use the index to skip blocks, and filters every row of the block passes
+        bool skip = false;
+        bool needFilter[COL_MAX_FILTERS];
+        for (int f = 0; f < numFilters; f++)
+        {
+            const colChunkEntry_t* chunk = &block->chunks[filters[f].column];
+            skip = skip || !colFilterMayPass(&filters[f], chunk);
+            needFilter[f] = !colFilterAllPass(&filters[f], chunk);
+        }
+        if (skip)
+        {
+            blocksSkipped++;
+            continue;
+        }
+
+        // Only decode the columns this query touches
+        bool decoded[COL_NUM_COLUMNS] = {false};
+        for (int c = 0; c < COL_NUM_COLUMNS; c++)
+        {
+            bool needed = aggregate[c];
+            for (int f = 0; f < numFilters; f++)
+            {
+                needed = needed || (needFilter[f] && filters[f].column == (column_t)c);
+            }
+            if (needed)
+            {
+                const colChunkEntry_t* chunk = &block->chunks[c];
+                colDecode((const uint64_t*)&file[chunk->offset], block->rows, values[c]);
+                bytesRead += chunk->size;
+                decoded[c] = true;
+            }
+        }
+
+        for (uint32_t r = 0; r < block->rows; r++)
+        {
+            pass[r] = true;
+            for (int f = 0; f < numFilters; f++)
+            {
+                pass[r] = pass[r] && (!needFilter[f] || colFilterPasses(&filters[f], values[filters[f].column][r]));
+            }
+        }
+        for (uint32_t r = 0; r < block->rows; r++)
+        {
+            if (!pass[r])
+            {
+                continue;
+            }
+            for (int c = 0; c < COL_NUM_COLUMNS; c++)
+            {
+                if (!decoded[c] || !aggregate[c])
+                {
+                    continue;
+                }
+                int64_t v = values[c][r];
+                min[c] = (0 == matches || v < min[c]) ? v : min[c];
+                max[c] = (0 == matches || v > max[c]) ? v : max[c];
+                ref[c] = (0 == matches) ? v : ref[c];
+                double d = (double)(v - ref[c]);
+                sum[c] += d;
+                sumSq[c] += d * d;
+            }
+            matches++;
+        }
+    }
+    double elapsed = nowSeconds() - start;
+
+    printf("%llu of %llu rows match, %llu of %u blocks skipped by the index\n", (unsigned long long)matches,
+           (unsigned long long)footer->rows, (unsigned long long)blocksSkipped, footer->numBlocks);
+    printf("decoded %.1f of %.1f MB in %.3fs (%.1f bytes/row in the file)\n\n", bytesRead / 1e6,
+           st.st_size / 1e6, elapsed, footer->rows ? st.st_size / (double)footer->rows : 0);
+    if (matches > 0)
+    {
+        printf("%-12s %12s %12s %10s %10s\n", "column", "min", "max", "mean", "std");
+        for (int c = 0; c < COL_NUM_COLUMNS; c++)
+        {
+            if (aggregate[c])
+            {
+                double meanDiff = sum[c] / matches;
+                double var = sumSq[c] / matches - meanDiff * meanDiff;
+                printf("%-12s %12lld %12lld %10.3f %10.3f\n", colNames[c], (long long)min[c], (long long)max[c],
+                       ref[c] + meanDiff, sqrt(var > 0 ? var : 0));
+            }
+        }
+    }
+
+    free(pass);
+    free(values);
+    munmap((void*)file, st.st_size);
+    return 0;
+}
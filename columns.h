@@ -0,0 +1,96 @@
+#ifndef _COLUMNS_H_
+#define _COLUMNS_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define COL_BLOCK_ROWS 16384 ///< Rows a worker buffers before writing a block
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+/// The columns of a per-lifetime results file, one row per lifetime
+typedef enum
+{
+    COL_LIFETIME,      ///< The lifetime's index in the whole run
+    COL_SEED,          ///< The lifetime's RNG seed
+    COL_POLICY,        ///< A policy_t
+    COL_CONFIG,        ///< configId() of the simulator that ran it
+    COL_HUNGER,
+    COL_HAPPY,
+    COL_DISCIPLINE,
+    COL_HEALTH,
+    COL_POOP_COUNT,
+    COL_ACTIONS_TAKEN,
+    COL_AGE,
+    COL_IS_SICK,
+    COL_NUM_COLUMNS,
+} column_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// One column's chunk of a block, as listed in the footer index
+typedef struct
+{
+    uint64_t offset; ///< File offset of the chunk
+    uint32_t size;   ///< Bytes in the chunk
+    uint32_t pad;
+    int64_t min;     ///< The smallest value in the chunk, so queries can skip blocks
+    int64_t max;     ///< The largest value in the chunk
+} colChunkEntry_t;
+
+/// A block of rows, as listed in the footer index
+typedef struct
+{
+    uint32_t rows;
+    uint32_t pad;
+    colChunkEntry_t chunks[COL_NUM_COLUMNS];
+} colBlockEntry_t;
+
+/// A per-lifetime results file being written. Workers append whole blocks to it
+typedef struct
+{
+    FILE* fp;
+    pthread_mutex_t lock;    ///< Guards everything below
+    uint64_t offset;         ///< Where the next block goes
+    colBlockEntry_t* blocks;
+    uint32_t numBlocks;
+    uint32_t capBlocks;
+    uint64_t rows;
+    bool failed;             ///< A write failed, the file is unusable
+} colWriter_t;
+
+/// A worker's buffer of rows not yet written
+typedef struct
+{
+    colWriter_t* writer;
+    uint32_t rows;
+    int64_t values[COL_NUM_COLUMNS][COL_BLOCK_ROWS];
+    uint64_t* scratch; ///< Where a block is encoded before it's written
+} colBuffer_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+colWriter_t* colWriterOpen(const char* path);
+bool colWriterClose(colWriter_t* writer);
+colBuffer_t* colBufferNew(colWriter_t* writer);
+void colBufferAdd(colBuffer_t* buf, uint32_t lifetime, uint64_t seed, policy_t policy, uint32_t config,
+                  const demon_t* pd);
+void colBufferFree(colBuffer_t* buf);
+int runQuery(char** args, int numArgs);
+
+#endif
@@ -2,142 +2,112 @@
  * Includes
  ******************************************************************************/
 
-#include <stdio.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <stdlib.h>
-#include <time.h>
-#include <string.h>
-#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "demon.h"
+#include "advisor.h"
+#include "mcts.h"
+#include "qlearn.h"
+#include "stats.h"
+#include "batch.h"
+#include "cache.h"
+#include "columns.h"
+#include "live.h"
+#include "split.h"
+#include "regress.h"
+#include "profile.h"
+#include "surrogate.h"
+#include "habitat.h"
 
 /*******************************************************************************
  * Defines
  ******************************************************************************/
 
-#define lengthof(x) (sizeof(x) / sizeof(x[0]))
-
-#define SQUARE(x) ((x)*(x))
-
-#define PRINT_F(...) do{if(!autoMode){printf(__VA_ARGS__);}}while(false)
-#define TALLY_ACTION() do{static int t=0; t++; PRINT_F("\n    %s() %d times\n", __func__, t);}while(false)
-
-#define INC_BOUND(base, inc, lbound, ubound) \
-    do{                                      \
-        if (base + inc > ubound) {           \
-            base = ubound;                   \
-        } else if (base + inc < lbound) {    \
-            base = lbound;                   \
-        } else {                             \
-            base += inc;                     \
-        }                                    \
-    } while(false)
-
-#define STOMACH_SIZE 5 // Max number of foods being digested
-
-// Every action modifies hunger somehow
-#define HUNGER_LOST_PER_FEEDING    5 ///< Hunger is lost when feeding
-#define HUNGER_GAINED_PER_PLAY     3 ///< Hunger is gained when playing
-#define HUNGER_GAINED_PER_SCOLD    1 ///< Hunger is gained when being scolded
-#define HUNGER_GAINED_PER_MEDICINE 1 ///< Hunger is gained when taking medicine
-#define HUNGER_GAINED_PER_FLUSH    1 ///< Hunger is gained when flushing
-
-#define OBESE_THRESHOLD        -6 ///< too fat (i.e. not hungry)
-#define MALNOURISHED_THRESHOLD  6 ///< too skinny (i.e. hungry)
-
-#define HAPPINESS_GAINED_PER_GAME                4 ///< Playing games increases happiness
-#define HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY 1 ///< Eating when hungry increases happiness
-#define HAPPINESS_LOST_PER_FEEDING_WHEN_FULL     3 ///< Eating when full decreases happiness
-#define HAPPINESS_LOST_PER_MEDICINE              4 ///< Taking medicine makes decreases happiness
-#define HAPPINESS_LOST_PER_STANDING_POOP         5 ///< Being around poop decreases happiness
-#define HAPPINESS_LOST_PER_SCOLDING              6 ///< Scolding decreases happiness
-
-// TODO once a demon gets unruly, its hard to get it back on track, cascading effect. unruly->refuse stuff->unhappy->unruly
-#define DISCIPLINE_GAINED_PER_SCOLDING 4 ///< Scolding increases discipline
-#define DISCIPLINE_LOST_RANDOMLY       2 ///< Discipline is randomly lost
-
-#define STARTING_HEALTH          20 ///< Health is started with, cannot be increased
-#define HEALTH_LOST_PER_SICKNESS  1 ///< Health is lost every turn while sick
-#define HEALTH_LOST_PER_OBE_MAL   2 ///< Health is lost every turn while obese or malnourished
-
-#define ACTIONS_UNTIL_TEEN  33
-#define ACTIONS_UNTIL_ADULT 66
-
-/*******************************************************************************
- * Enums
- ******************************************************************************/
-
-typedef enum
-{
-    EVT_NONE,
-    EVT_GOT_SICK_RANDOMLY,
-    EVT_GOT_SICK_POOP,
-    EVT_GOT_SICK_OBESE,
-    EVT_GOT_SICK_MALNOURISHED,
-    EVT_POOPED,
-    EVT_LOST_DISCIPLINE,
-    EVT_NUM_EVENTS,
-} event_t;
-
-typedef enum
-{
-    AGE_CHILD,
-    AGE_TEEN,
-    AGE_ADULT
-} age_t;
+#define EVQ_SPILL_MIN 64 ///< Events a new heap queue holds, doubled when it fills
 
 /*******************************************************************************
  * Structs
  ******************************************************************************/
 
-typedef struct _eventQueue_t
-{
-    struct _eventQueue_t* next;
-    event_t event;
-} eventQueue_t;
-
-typedef struct
+/// A ring of a demon's events on the heap, one byte each
+struct evSpill
 {
-    int32_t hunger; ///< 0 hunger is perfect, positive means too hungry, negative means too full
-    int32_t happy;
-    int32_t discipline;
-    int32_t health;
-    int32_t poopCount;
-    int32_t actionsTaken;
-    bool isSick;
-    int32_t stomach[STOMACH_SIZE];
-    char name[32];
-    age_t age;
-    eventQueue_t* evQueue;
-} demon_t;
+    uint32_t head; ///< Index of the oldest event in evts
+    uint32_t len;  ///< Number of events in evts
+    uint32_t cap;  ///< Size of evts, a power of 2
+    uint8_t evts[];
+};
 
 /*******************************************************************************
- * Prototypes
+ * Variables
  ******************************************************************************/
 
-void namegen(char* name, int namelen);
-bool eatFood(demon_t* pd);
-void feedDemon(demon_t* pd);
-void playWithDemon(demon_t* pd);
-void disciplineDemon(demon_t* pd);
-bool disciplineCheck(demon_t* pd);
-void medicineDemon(demon_t* pd);
-void scoopPoop(demon_t* pd);
-void updateStatus(demon_t* pd);
-void printStats(demon_t* pd);
-char getInput(demon_t* pd);
-bool takeAction(demon_t* pd);
-void resetDemon(demon_t* pd);
-
-event_t dequeueEvt(demon_t* pd);
-void enqueueEvt(demon_t* pd, event_t evt);
+// Event counts are per thread so parallel simulations don't share them
+_Thread_local uint32_t evtCtr[EVT_NUM_EVENTS] = {0};
 
-/*******************************************************************************
- * Variables
- ******************************************************************************/
+// Auto mode is per thread, so background simulations stay quiet while a human plays
+_Thread_local bool autoMode = false;
+
+// Heap event queue traffic is per thread too, so profile mode can report it
+_Thread_local evqHeap_t evqHeap = {0};
+policy_t autoPolicy = POLICY_HEURISTIC;
 
-uint32_t evtCtr[EVT_NUM_EVENTS] = {0};
+const char* policyNames[POLICY_NUM_POLICIES] =
+{
+    "heuristic",
+    "random",
+    "mcts",
+    "qtable",
+};
 
-bool autoMode = false;
+const char* demonStatNames[DSTAT_NUM_STATS] =
+{
+    "hunger",
+    "happy",
+    "discipline",
+    "health",
+    "poopCount",
+    "actionsTaken",
+};
+
+const char* evtNames[EVT_NUM_EVENTS] =
+{
+    "EVT_NONE",
+    "EVT_GOT_SICK_RANDOMLY",
+    "EVT_GOT_SICK_POOP",
+    "EVT_GOT_SICK_OBESE",
+    "EVT_GOT_SICK_MALNOURISHED",
+    "EVT_POOPED",
+    "EVT_LOST_DISCIPLINE",
+};
+
+// The game's constants, in the order configId() hashes them
+const gameConstant_t gameConstants[] =
+{
+    {"STOMACH_SIZE", STOMACH_SIZE},
+    {"HUNGER_LOST_PER_FEEDING", HUNGER_LOST_PER_FEEDING},
+    {"HUNGER_GAINED_PER_PLAY", HUNGER_GAINED_PER_PLAY},
+    {"HUNGER_GAINED_PER_SCOLD", HUNGER_GAINED_PER_SCOLD},
+    {"HUNGER_GAINED_PER_MEDICINE", HUNGER_GAINED_PER_MEDICINE},
+    {"HUNGER_GAINED_PER_FLUSH", HUNGER_GAINED_PER_FLUSH},
+    {"OBESE_THRESHOLD", OBESE_THRESHOLD},
+    {"MALNOURISHED_THRESHOLD", MALNOURISHED_THRESHOLD},
+    {"HAPPINESS_GAINED_PER_GAME", HAPPINESS_GAINED_PER_GAME},
+    {"HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY", HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY},
+    {"HAPPINESS_LOST_PER_FEEDING_WHEN_FULL", HAPPINESS_LOST_PER_FEEDING_WHEN_FULL},
+    {"HAPPINESS_LOST_PER_MEDICINE", HAPPINESS_LOST_PER_MEDICINE},
+    {"HAPPINESS_LOST_PER_STANDING_POOP", HAPPINESS_LOST_PER_STANDING_POOP},
+    {"HAPPINESS_LOST_PER_SCOLDING", HAPPINESS_LOST_PER_SCOLDING},
+    {"DISCIPLINE_GAINED_PER_SCOLDING", DISCIPLINE_GAINED_PER_SCOLDING},
+    {"DISCIPLINE_LOST_RANDOMLY", DISCIPLINE_LOST_RANDOMLY},
+    {"STARTING_HEALTH", STARTING_HEALTH},
+    {"HEALTH_LOST_PER_SICKNESS", HEALTH_LOST_PER_SICKNESS},
+    {"HEALTH_LOST_PER_OBE_MAL", HEALTH_LOST_PER_OBE_MAL},
+    {"ACTIONS_UNTIL_TEEN", ACTIONS_UNTIL_TEEN},
+    {"ACTIONS_UNTIL_ADULT", ACTIONS_UNTIL_ADULT},
+};
+const uint32_t numGameConstants = lengthof(gameConstants);
 
 // const char *nm1[] = {"", "b", "br", "d", "dr", "g", "j", "k", "m", "r", "s", "t", "th", "tr", "v", "x", "z"};
 // const char *nm2[] = {"a", "e", "i", "o", "u"};
@@ -152,6 +122,14 @@ const char* nm4[] = {"a", "e", "i", "o", "u", "a", "a", "o", "o", "a", "e", "i",
 const char* nm5[] = {"d", "k", "l", "ll", "m", "m", "m", "n", "n", "n", "nn", "r", "r", "r", "th", "x", "z"};
 const char* nm6[] = {"ch", "d", "g", "k", "l", "n", "n", "n", "n", "n", "r", "s", "th", "th", "th", "th", "th", "z"};
 
+// Interned demon names. Entry 0 is the empty name, for demons that were never named
+char (*nameTable)[NAME_LEN] = NULL;
+uint32_t nameTableLen = 0;
+uint32_t nameTableCap = 0;
+// Open addressed hash index into nameTable, each slot holds an ID + 1, or 0 if empty
+uint32_t* nameHash = NULL;
+uint32_t nameHashCap = 0;
+
 /*******************************************************************************
  * Functions
  ******************************************************************************/
@@ -202,56 +180,162 @@ void namegen(char* name, int namelen)
 }
 
 /**
- * Feed a demon
- * Feeding makes the demon happier if it is hungry
+ * @brief Hash a name for the interned name table (FNV-1a)
  *
- * @param pd The demon
+ * @param name The name to hash
+ * @return The hash
  */
-void feedDemon(demon_t* pd)
+static uint32_t hashName(const char* name)
 {
-    TALLY_ACTION();
-    // Count feeding as an action
-    INC_BOUND(pd->actionsTaken, 1, 0, INT16_MAX);
+    uint32_t hash = 2166136261u;
+    while (*name)
+    {
+        hash ^= (uint8_t)(*name++);
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    // If the demon is sick, there's a 50% chance it refuses to eat
-    if (pd->isSick && rand() % 2)
+/**
+ * @brief Find or add a name in the interned name table
+ *
+ * @param name The name to intern
+ * @return The name's ID, to be stored in demon_t.nameId
+ */
+uint32_t internName(const char* name)
+{
+    // Lazily set up the table with the empty name as ID 0
+    if (NULL == nameTable)
     {
-        PRINT_F("%s was too sick to eat\n", pd->name);
-        // Get a bit hungrier
-        INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE,  INT32_MIN, INT32_MAX);
+        nameTableCap = 64;
+        nameTable = calloc(nameTableCap, NAME_LEN);
+        nameTableLen = 1;
+        nameHashCap = 2 * nameTableCap;
+        nameHash = calloc(nameHashCap, sizeof(uint32_t));
     }
-    // If the demon is unruly, it may refuse to eat
-    else if (disciplineCheck(pd))
+
+    if ('\0' == name[0])
+    {
+        return 0;
+    }
+
+    // Look for the name, stopping at the first empty slot
+    uint32_t slot = hashName(name) & (nameHashCap - 1);
+    while (0 != nameHash[slot])
     {
-        if(rand() % 2 == 0)
+        if (0 == strncmp(nameTable[nameHash[slot] - 1], name, NAME_LEN))
         {
-            PRINT_F("%s was too unruly eat\n", pd->name);
-            // Get a bit hungrier
-            INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE,  INT32_MIN, INT32_MAX);
+            return nameHash[slot] - 1;
         }
-        else
+        slot = (slot + 1) & (nameHashCap - 1);
+    }
+
+    // Not found, so append it. IDs are 16 bits in the demon, past that names are dropped
+    if (nameTableLen > UINT16_MAX)
+    {
+        return 0;
+    }
+    if (nameTableLen == nameTableCap)
+    {
+        nameTableCap *= 2;
+        nameTable = realloc(nameTable, nameTableCap * (size_t)NAME_LEN);
+
+        // Rebuild the hash index at twice the table size to keep it sparse
+        free(nameHash);
+        nameHashCap = 2 * nameTableCap;
+        nameHash = calloc(nameHashCap, sizeof(uint32_t));
+        for (uint32_t id = 1; id < nameTableLen; id++)
         {
-            // Eat as much as possible
-            for(int i = 0; i < 3; i++)
+            uint32_t s = hashName(nameTable[id]) & (nameHashCap - 1);
+            while (0 != nameHash[s])
             {
-                eatFood(pd);
+                s = (s + 1) & (nameHashCap - 1);
             }
-            PRINT_F("%s ate the food, then stole more and overate\n", pd->name);
+            nameHash[s] = id + 1;
         }
-    }
-    // Normal feeding
-    else
-    {
-        // Normal feeding is successful
-        if(eatFood(pd))
+        slot = hashName(name) & (nameHashCap - 1);
+        while (0 != nameHash[slot])
         {
-            PRINT_F("%s ate the food\n", pd->name);
+            slot = (slot + 1) & (nameHashCap - 1);
         }
-        else
+    }
+
+    uint32_t id = nameTableLen++;
+    strncpy(nameTable[id], name, NAME_LEN - 1);
+    nameTable[id][NAME_LEN - 1] = '\0';
+    nameHash[slot] = id + 1;
+    return id;
+}
+
+/**
+ * @brief Look up a demon's name in the interned name table
+ *
+ * @param pd The demon
+ * @return The demon's name, or an empty string if it was never named
+ */
+const char* demonName(const demon_t* pd)
+{
+    if (NULL == nameTable || pd->nameId >= nameTableLen)
+    {
+        return "";
+    }
+    return nameTable[pd->nameId];
+}
+
+/**
+ * @brief Check if the demon is being unruly. The age is passed separately so
+ * that callers with a compile-time age get a branch-free specialization
+ *
+ * @param pd  The demon
+ * @param age The demon's age
+ * @return true if the demon is being unruly (won't take action)
+ */
+static ALWAYS_INLINE bool disciplineCheckAged(demon_t* pd, age_t age)
+{
+    if (pd->discipline < 0)
+    {
+        switch (pd->discipline)
         {
-            PRINT_F("%s was too full to eat\n", pd->name);
+            case -1:
+            {
+                return (demonRand(pd) % 8) < 4;
+            }
+            case -2:
+            {
+                return (demonRand(pd) % 8) < 5;
+            }
+            case -3:
+            {
+                return (demonRand(pd) % 8) < 6;
+            }
+            default:
+            {
+                return (demonRand(pd) % 8) < 7;
+            }
         }
     }
+    else if(AGE_TEEN == age)
+    {
+        return (demonRand(pd) % 8) < 2;
+    }
+    else if(AGE_ADULT == age)
+    {
+        return (demonRand(pd) % 8) < 1;
+    }
+    else
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief
+ *
+ * @return true if the demon is being unruly (won't take action)
+ */
+bool disciplineCheck(demon_t* pd)
+{
+    return disciplineCheckAged(pd, pd->age);
 }
 
 /**
@@ -265,23 +349,24 @@ bool eatFood(demon_t* pd)
     // Make sure there's room in the stomach first
     for (int i = 0; i < STOMACH_SIZE; i++)
     {
-        if (pd->stomach[i] == 0)
+        int shift = i * STOMACH_NIBBLE_BITS;
+        if (((pd->stomach >> shift) & STOMACH_NIBBLE_MASK) == 0)
         {
             // If the demon eats when hungry, it gets happy, otherwise it gets sad
             if (pd->hunger > 0)
             {
-                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY,  INT32_MIN, INT32_MAX);
+                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY, INT16_MIN, INT16_MAX);
             }
             else
             {
-                INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_FEEDING_WHEN_FULL,  INT32_MIN, INT32_MAX);
+                INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_FEEDING_WHEN_FULL, INT16_MIN, INT16_MAX);
             }
 
             // Give the food between 4 and 7 cycles to digest
-            pd->stomach[i] = 3 + (rand() % 4);
+            pd->stomach |= (uint32_t)(3 + (demonRand(pd) % 4)) << shift;
 
             // Feeding always makes the demon less hungry
-            INC_BOUND(pd->hunger, -HUNGER_LOST_PER_FEEDING,  INT32_MIN, INT32_MAX);
+            INC_BOUND(pd->hunger, -HUNGER_LOST_PER_FEEDING, INT8_MIN, INT8_MAX);
             return true;
         }
     }
@@ -289,44 +374,123 @@ bool eatFood(demon_t* pd)
 }
 
 /**
- * Play with the demon
+ * Feed a demon of a given age
+ *
+ * @param pd  The demon
+ * @param age The demon's age
+ */
+static ALWAYS_INLINE void feedDemonAged(demon_t* pd, age_t age)
+{
+    // Count feeding as an action
+    INC_BOUND(pd->actionsTaken, 1, 0, INT16_MAX);
+
+    // If the demon is sick, there's a 50% chance it refuses to eat
+    if (pd->isSick && demonRand(pd) % 2)
+    {
+        PRINT_F("%s was too sick to eat\n", demonName(pd));
+        // Get a bit hungrier
+        INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE, INT8_MIN, INT8_MAX);
+    }
+    // If the demon is unruly, it may refuse to eat
+    else if (disciplineCheckAged(pd, age))
+    {
+        if(demonRand(pd) % 2 == 0)
+        {
+            PRINT_F("%s was too unruly eat\n", demonName(pd));
+            // Get a bit hungrier
+            INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE, INT8_MIN, INT8_MAX);
+        }
+        else
+        {
+            // Eat as much as possible
+            for(int i = 0; i < 3; i++)
+            {
+                eatFood(pd);
+            }
+            PRINT_F("%s ate the food, then stole more and overate\n", demonName(pd));
+        }
+    }
+    // Normal feeding
+    else
+    {
+        // Normal feeding is successful
+        if(eatFood(pd))
+        {
+            PRINT_F("%s ate the food\n", demonName(pd));
+        }
+        else
+        {
+            PRINT_F("%s was too full to eat\n", demonName(pd));
+        }
+    }
+}
+
+/**
+ * Feed a demon
+ * Feeding makes the demon happier if it is hungry
  *
  * @param pd The demon
  */
-void playWithDemon(demon_t* pd)
+void feedDemon(demon_t* pd)
 {
     TALLY_ACTION();
+    feedDemonAged(pd, pd->age);
+}
+
+/**
+ * Play with the demon of a given age
+ *
+ * @param pd  The demon
+ * @param age The demon's age
+ */
+static ALWAYS_INLINE void playWithDemonAged(demon_t* pd, age_t age)
+{
     // Count playing as an action
     INC_BOUND(pd->actionsTaken, 1, 0, INT16_MAX);
 
-    if (disciplineCheck(pd))
+    if (disciplineCheckAged(pd, age))
     {
-        PRINT_F("%s was too unruly to play\n", pd->name);
+        PRINT_F("%s was too unruly to play\n", demonName(pd));
     }
     else
     {
         // Playing makes the demon happy
-        switch(pd->age)
+        switch(age)
         {
             case AGE_CHILD:
             case AGE_TEEN:
             {
-                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_GAME,  INT32_MIN, INT32_MAX);
+                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_GAME, INT16_MIN, INT16_MAX);
                 break;
             }
             case AGE_ADULT:
             {
                 // Adults don't get as happy per play as kids
-                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_GAME / 2,  INT32_MIN, INT32_MAX);
+                INC_BOUND(pd->happy, HAPPINESS_GAINED_PER_GAME / 2, INT16_MIN, INT16_MAX);
+                break;
+            }
+            case AGE_NUM_AGES:
+            {
                 break;
             }
         }
 
-        PRINT_F("You played with %s\n", pd->name);
+        PRINT_F("You played with %s\n", demonName(pd));
     }
 
     // Playing makes the demon hungry
-    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_PLAY,  INT32_MIN, INT32_MAX);
+    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_PLAY, INT8_MIN, INT8_MAX);
+}
+
+/**
+ * Play with the demon
+ *
+ * @param pd The demon
+ */
+void playWithDemon(demon_t* pd)
+{
+    TALLY_ACTION();
+    playWithDemonAged(pd, pd->age);
 }
 
 /**
@@ -341,64 +505,21 @@ void disciplineDemon(demon_t* pd)
     INC_BOUND(pd->actionsTaken, 1, 0, INT16_MAX);
 
     // Discipline always reduces happiness
-    INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_SCOLDING,  INT32_MIN, INT32_MAX);
+    INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_SCOLDING, INT16_MIN, INT16_MAX);
 
     // Discipline only increases if the demon is not sick
     if (false == pd->isSick)
     {
-        INC_BOUND(pd->discipline, DISCIPLINE_GAINED_PER_SCOLDING,  INT32_MIN, INT32_MAX);
-        PRINT_F("You scolded %s\n", pd->name);
+        INC_BOUND(pd->discipline, DISCIPLINE_GAINED_PER_SCOLDING, INT8_MIN, INT8_MAX);
+        PRINT_F("You scolded %s\n", demonName(pd));
     }
     else
     {
-        PRINT_F("You scolded %s, but it was sick\n", pd->name);
+        PRINT_F("You scolded %s, but it was sick\n", demonName(pd));
     }
 
     // Disciplining makes the demon hungry
-    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_SCOLD,  INT32_MIN, INT32_MAX);
-}
-
-/**
- * @brief
- *
- * @return true if the demon is being unruly (won't take action)
- */
-bool disciplineCheck(demon_t* pd)
-{
-    if (pd->discipline < 0)
-    {
-        switch (pd->discipline)
-        {
-            case -1:
-            {
-                return (rand() % 8) < 4;
-            }
-            case -2:
-            {
-                return (rand() % 8) < 5;
-            }
-            case -3:
-            {
-                return (rand() % 8) < 6;
-            }
-            default:
-            {
-                return (rand() % 8) < 7;
-            }
-        }
-    }
-    else if(AGE_TEEN == pd->age)
-    {
-        return (rand() % 8) < 2;
-    }
-    else if(AGE_ADULT == pd->age)
-    {
-        return (rand() % 8) < 1;
-    }
-    else
-    {
-        return false;
-    }
+    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_SCOLD, INT8_MIN, INT8_MAX);
 }
 
 /**
@@ -413,21 +534,21 @@ void medicineDemon(demon_t* pd)
     INC_BOUND(pd->actionsTaken, 1, 0, INT16_MAX);
 
     // 6/8 chance the demon is healed
-    if (rand() % 8 < 6)
+    if (demonRand(pd) % 8 < 6)
     {
-        PRINT_F("You gave %s medicine, and it was cured\n", pd->name);
+        PRINT_F("You gave %s medicine, and it was cured\n", demonName(pd));
         pd->isSick = false;
     }
     else
     {
-        PRINT_F("You gave %s medicine, but it didn't work\n", pd->name);
+        PRINT_F("You gave %s medicine, but it didn't work\n", demonName(pd));
     }
 
     // Giving medicine to the demon makes the demon hungry
-    INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_MEDICINE,  INT32_MIN, INT32_MAX);
+    INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_MEDICINE, INT16_MIN, INT16_MAX);
 
     // Giving medicine to the demon makes the demon hungry
-    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE,  INT32_MIN, INT32_MAX);
+    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_MEDICINE, INT8_MIN, INT8_MAX);
 }
 
 /**
@@ -445,7 +566,7 @@ void scoopPoop(demon_t* pd)
     if (pd->poopCount > 0)
     {
         PRINT_F("You flushed a poop\n");
-        INC_BOUND(pd->poopCount, -1,  INT32_MIN, INT32_MAX);
+        INC_BOUND(pd->poopCount, -1, INT8_MIN, INT8_MAX);
     }
     else
     {
@@ -453,63 +574,158 @@ void scoopPoop(demon_t* pd)
     }
 
     // Flushing makes the demon hungry
-    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_FLUSH,  INT32_MIN, INT32_MAX);
+    INC_BOUND(pd->hunger, HUNGER_GAINED_PER_FLUSH, INT8_MIN, INT8_MAX);
 }
 
 /**
- * This is called after every action.
- * If there is poop, check if the demon becomes sick
- * If the demon is malnourished or obese, check if the demon becomes sick
- * If the demon is malnourished or obese, decrease health
- * If the demon is sick, decrease health (separately from obese / malnourised)
- * If food has been digested, make a poop
- * If health reaches zero, the demon is dead
+ * Process one event from the demon's queue. The age is the one after any age
+ * transition from this call to updateStatus()
  *
- * @param pd The demon
+ * @param pd  The demon
+ * @param age The demon's age
  */
-void updateStatus(demon_t* pd)
+static ALWAYS_INLINE void processEvtAged(demon_t* pd, age_t age)
 {
-    /***************************************************************************
-     * Sick Status
-     **************************************************************************/
-
-    // If the demon is sick, decrease health
-    if (pd->isSick)
-    {
-        INC_BOUND(pd->health, -HEALTH_LOST_PER_SICKNESS,  INT32_MIN, INT32_MAX);
-        PRINT_F("%s lost health to sickness\n", pd->name);
-    }
-
-    // The demon randomly gets sick
-    if (rand() % 12 == 0)
-    {
-        enqueueEvt(pd, EVT_GOT_SICK_RANDOMLY);
-    }
-
-    /***************************************************************************
-     * Poop Status
-     **************************************************************************/
-
-    // Check if demon should poop
-    for (int i = 0; i < STOMACH_SIZE; i++)
+    switch(dequeueEvt(pd))
     {
-        if (pd->stomach[i] > 0)
+        default:
+        case EVT_NONE:
+        {
+            // Nothing
+            break;
+        }
+        case EVT_GOT_SICK_RANDOMLY:
         {
-            pd->stomach[i]--;
-            // If the food was digested
-            if (0 == pd->stomach[i])
+            if(false == pd->isSick)
             {
-                enqueueEvt(pd, EVT_POOPED);
+                pd->isSick = true;
+                PRINT_F("%s randomly got sick\n", demonName(pd));
             }
+            break;
         }
-    }
-
-    // Check if poop makes demon sick
+        case EVT_GOT_SICK_POOP:
+        {
+            if(false == pd->isSick)
+            {
+                pd->isSick = true;
+                PRINT_F("Poop made %s sick\n", demonName(pd));
+            }
+            break;
+        }
+        case EVT_GOT_SICK_OBESE:
+        {
+            if(false == pd->isSick)
+            {
+                pd->isSick = true;
+                PRINT_F("Obesity made %s sick\n", demonName(pd));
+            }
+            break;
+        }
+        case EVT_GOT_SICK_MALNOURISHED:
+        {
+            if(false == pd->isSick)
+            {
+                pd->isSick = true;
+                PRINT_F("Malnourishment made %s sick\n", demonName(pd));
+            }
+            break;
+        }
+        case EVT_POOPED:
+        {
+            // Make a poop
+            INC_BOUND(pd->poopCount, 1, INT8_MIN, INT8_MAX);
+            PRINT_F("%s pooped\n", demonName(pd));
+            break;
+        }
+        case EVT_LOST_DISCIPLINE:
+        {
+            switch(age)
+            {
+                case AGE_CHILD:
+                {
+                    // Kids don't lose discipline, they're good kids!
+                    break;
+                }
+                case AGE_TEEN:
+                {
+                    // Rebellious teenage years lose triple discipline
+                    PRINT_F("%s became less disciplined\n", demonName(pd));
+                    INC_BOUND(pd->discipline, 3 * -DISCIPLINE_LOST_RANDOMLY, INT8_MIN, INT8_MAX);
+                    break;
+                }
+                case AGE_ADULT:
+                {
+                    // Adults calm down a bit
+                    PRINT_F("%s became less disciplined\n", demonName(pd));
+                    INC_BOUND(pd->discipline, -DISCIPLINE_LOST_RANDOMLY, INT8_MIN, INT8_MAX);
+                    break;
+                }
+                case AGE_NUM_AGES:
+                {
+                    break;
+                }
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * This is called after every action, for a demon of a given age.
+ * If there is poop, check if the demon becomes sick
+ * If the demon is malnourished or obese, check if the demon becomes sick
+ * If the demon is malnourished or obese, decrease health
+ * If the demon is sick, decrease health (separately from obese / malnourised)
+ * If food has been digested, make a poop
+ * If health reaches zero, the demon is dead
+ *
+ * @param pd  The demon
+ * @param age The demon's age at the start of this call
+ */
+static ALWAYS_INLINE void updateStatusAged(demon_t* pd, age_t age)
+{
+    /***************************************************************************
+     * Sick Status
+     **************************************************************************/
+
+    // If the demon is sick, decrease health
+    if (pd->isSick)
+    {
+        INC_BOUND(pd->health, -HEALTH_LOST_PER_SICKNESS, INT8_MIN, INT8_MAX);
+        PRINT_F("%s lost health to sickness\n", demonName(pd));
+    }
+
+    // The demon randomly gets sick
+    if (demonRand(pd) % 12 == 0)
+    {
+        enqueueEvt(pd, EVT_GOT_SICK_RANDOMLY);
+    }
+
+    /***************************************************************************
+     * Poop Status
+     **************************************************************************/
+
+    // Check if demon should poop. All digest timers are decremented at once:
+    // fold each nibble onto its low bit to find the foods being digested, then
+    // subtract one from just those nibbles, which can never borrow
+    uint32_t digesting = (pd->stomach | (pd->stomach >> 1) | (pd->stomach >> 2) | (pd->stomach >> 3)) &
+                         STOMACH_NIBBLE_LSBS;
+    pd->stomach -= digesting;
+
+    // Foods which were digesting and are now zero were digested
+    uint32_t digested = digesting &
+                        ~(pd->stomach | (pd->stomach >> 1) | (pd->stomach >> 2) | (pd->stomach >> 3));
+    for (int i = __builtin_popcount(digested); i > 0; i--)
+    {
+        enqueueEvt(pd, EVT_POOPED);
+    }
+
+    // Check if poop makes demon sick
     // 1 poop  -> 25% chance
     // 2 poop  -> 50% chance
     // 3 poop  -> 75% chance
     // 4+ poop -> 100% chance
-    if (rand() % 4 > (3 - pd->poopCount))
+    if (demonRand(pd) % 4 > (3 - pd->poopCount))
     {
         enqueueEvt(pd, EVT_GOT_SICK_POOP);
     }
@@ -517,7 +733,7 @@ void updateStatus(demon_t* pd)
     // Being around poop makes the demon sad
     if (pd->poopCount > 0)
     {
-        INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_STANDING_POOP, INT32_MIN, INT32_MAX);
+        INC_BOUND(pd->happy, -HAPPINESS_LOST_PER_STANDING_POOP, INT16_MIN, INT16_MAX);
     }
 
     /***************************************************************************
@@ -528,27 +744,27 @@ void updateStatus(demon_t* pd)
     if (pd->hunger < OBESE_THRESHOLD)
     {
         // 5/8 chance the demon becomes sick
-        if ((rand() % 8) >= 5)
+        if ((demonRand(pd) % 8) >= 5)
         {
             enqueueEvt(pd, EVT_GOT_SICK_OBESE);
         }
 
         // decrease the health
-        INC_BOUND(pd->health, -HEALTH_LOST_PER_OBE_MAL,  INT32_MIN, INT32_MAX);
+        INC_BOUND(pd->health, -HEALTH_LOST_PER_OBE_MAL, INT8_MIN, INT8_MAX);
 
-        PRINT_F("%s lost health to obesity\n", pd->name);
+        PRINT_F("%s lost health to obesity\n", demonName(pd));
     }
     else if (pd->hunger > MALNOURISHED_THRESHOLD)
     {
         // 5/8 chance the demon becomes sick
-        if ((rand() % 8) >= 5)
+        if ((demonRand(pd) % 8) >= 5)
         {
             enqueueEvt(pd, EVT_GOT_SICK_MALNOURISHED);
         }
 
         // decrease the health
-        INC_BOUND(pd->health, -HEALTH_LOST_PER_OBE_MAL,  INT32_MIN, INT32_MAX);
-        PRINT_F("%s lost health to malnourishment\n", pd->name);
+        INC_BOUND(pd->health, -HEALTH_LOST_PER_OBE_MAL, INT8_MIN, INT8_MAX);
+        PRINT_F("%s lost health to malnourishment\n", demonName(pd));
     }
 
     /***************************************************************************
@@ -561,11 +777,11 @@ void updateStatus(demon_t* pd)
     // -1  -> 50%
     // -2  -> 75%
     // -3  -> 100%
-    if (pd->happy > 0 && rand() % 16 < 1)
+    if (pd->happy > 0 && demonRand(pd) % 16 < 1)
     {
         enqueueEvt(pd, EVT_LOST_DISCIPLINE);
     }
-    else if (pd->happy <= 0 && rand() % 4 < (1 - pd->happy))
+    else if (pd->happy <= 0 && demonRand(pd) % 4 < (1 - pd->happy))
     {
         enqueueEvt(pd, EVT_LOST_DISCIPLINE);
     }
@@ -574,98 +790,25 @@ void updateStatus(demon_t* pd)
      * Age status
      **************************************************************************/
 
-    if(pd->age == AGE_CHILD && pd->actionsTaken >= ACTIONS_UNTIL_TEEN)
+    if(age == AGE_CHILD && pd->actionsTaken >= ACTIONS_UNTIL_TEEN)
     {
-        PRINT_F("%s is now a teenager. Watch out.\n", pd->name);
+        PRINT_F("%s is now a teenager. Watch out.\n", demonName(pd));
         pd->age = AGE_TEEN;
+        processEvtAged(pd, AGE_TEEN);
     }
-    else if(pd->age == AGE_TEEN && pd->actionsTaken >= ACTIONS_UNTIL_ADULT)
+    else if(age == AGE_TEEN && pd->actionsTaken >= ACTIONS_UNTIL_ADULT)
     {
-        PRINT_F("%s is now an adult. Boring.\n", pd->name);
+        PRINT_F("%s is now an adult. Boring.\n", demonName(pd));
         pd->age = AGE_ADULT;
+        processEvtAged(pd, AGE_ADULT);
     }
-
-    /***************************************************************************
-     * Process one event per call
-     **************************************************************************/
-
-    switch(dequeueEvt(pd))
+    else
     {
-        default:
-        case EVT_NONE:
-        {
-            // Nothing
-            break;
-        }
-        case EVT_GOT_SICK_RANDOMLY:
-        {
-            if(false == pd->isSick)
-            {
-                pd->isSick = true;
-                PRINT_F("%s randomly got sick\n", pd->name);
-            }
-            break;
-        }
-        case EVT_GOT_SICK_POOP:
-        {
-            if(false == pd->isSick)
-            {
-                pd->isSick = true;
-                PRINT_F("Poop made %s sick\n", pd->name);
-            }
-            break;
-        }
-        case EVT_GOT_SICK_OBESE:
-        {
-            if(false == pd->isSick)
-            {
-                pd->isSick = true;
-                PRINT_F("Obesity made %s sick\n", pd->name);
-            }
-            break;
-        }
-        case EVT_GOT_SICK_MALNOURISHED:
-        {
-            if(false == pd->isSick)
-            {
-                pd->isSick = true;
-                PRINT_F("Malnourishment made %s sick\n", pd->name);
-            }
-            break;
-        }
-        case EVT_POOPED:
-        {
-            // Make a poop
-            pd->poopCount++;
-            PRINT_F("%s pooped\n", pd->name);
-            break;
-        }
-        case EVT_LOST_DISCIPLINE:
-        {
-            switch(pd->age)
-            {
-                case AGE_CHILD:
-                {
-                    // Kids don't lose discipline, they're good kids!
-                    break;
-                }
-                case AGE_TEEN:
-                {
-                    // Rebellious teenage years lose triple discipline
-                    PRINT_F("%s became less disciplined\n", pd->name);
-                    INC_BOUND(pd->discipline, 3 * -DISCIPLINE_LOST_RANDOMLY,  INT32_MIN, INT32_MAX);
-                    break;
-                }
-                case AGE_ADULT:
-                {
-                    // Adults calm down a bit
-                    PRINT_F("%s became less disciplined\n", pd->name);
-                    INC_BOUND(pd->discipline, -DISCIPLINE_LOST_RANDOMLY,  INT32_MIN, INT32_MAX);
-                    break;
-                }
-            }
-            break;
-        }
+        /***********************************************************************
+         * Process one event per call
+         **********************************************************************/
+
+        processEvtAged(pd, age);
     }
 
     /***************************************************************************
@@ -675,12 +818,23 @@ void updateStatus(demon_t* pd)
     // Zero health means the demon died
     if (pd->health <= 0)
     {
-        PRINT_F("%s died\n", pd->name);
-        // Empty and free the event queue
+        PRINT_F("%s died\n", demonName(pd));
+        // Empty the event queue, which frees a heap queue
         while(EVT_NONE != dequeueEvt(pd)) {;}
     }
 }
 
+/**
+ * This is called after every action.
+ * See updateStatusAged() for what happens
+ *
+ * @param pd The demon
+ */
+void updateStatus(demon_t* pd)
+{
+    updateStatusAged(pd, pd->age);
+}
+
 /**
  * Print out a demon's current status
  *
@@ -701,42 +855,129 @@ void printStats(demon_t* pd)
 }
 
 /**
- * Helper function to enable auto mode
+ * @brief Get one of a demon's reported stats, widened
  *
- * @return char
+ * @param pd   The demon
+ * @param stat The stat to get
+ * @return The value of that stat
  */
-char getInput(demon_t* pd)
+int32_t getDemonStat(const demon_t* pd, demonStat_t stat)
 {
-    if (autoMode)
+    switch (stat)
     {
-        if (pd->health <= 0)
+        case DSTAT_HUNGER:
         {
-            return 'q';
+            return pd->hunger;
         }
-        else if (pd->isSick)
+        case DSTAT_HAPPY:
         {
-            return '4';
+            return pd->happy;
         }
-        else if (pd->hunger > MALNOURISHED_THRESHOLD)
+        case DSTAT_DISCIPLINE:
         {
-            return '1';
+            return pd->discipline;
         }
-        else if (pd->poopCount > 0)
+        case DSTAT_HEALTH:
         {
-            return '5';
+            return pd->health;
         }
-        else if (pd->discipline < 0)
+        case DSTAT_POOP_COUNT:
         {
-            return '3';
+            return pd->poopCount;
         }
-        else if (pd->hunger > 0)
+        case DSTAT_ACTIONS_TAKEN:
         {
-            return '1';
+            return pd->actionsTaken;
         }
-        else
+        default:
+        case DSTAT_NUM_STATS:
+        {
+            return 0;
+        }
+    }
+}
+
+/**
+ * Pick an action for a demon with one of the built in policies
+ *
+ * @param pd     The demon
+ * @param policy The policy to pick with
+ * @return The menu character for the action
+ */
+static ALWAYS_INLINE char getPolicyInput(demon_t* pd, policy_t policy)
+{
+    if (pd->health <= 0)
+    {
+        return 'q';
+    }
+
+    switch (policy)
+    {
+        case POLICY_RANDOM:
+        {
+            return '1' + (demonRand(pd) % 5);
+        }
+        case POLICY_MCTS:
+        {
+            return mctsGetInput(pd);
+        }
+        case POLICY_QTABLE:
         {
-            return '2';
+            return qtableGetInput(pd);
         }
+        default:
+        case POLICY_HEURISTIC:
+        {
+            if (pd->isSick)
+            {
+                return '4';
+            }
+            else if (pd->hunger > MALNOURISHED_THRESHOLD)
+            {
+                return '1';
+            }
+            else if (pd->poopCount > 0)
+            {
+                return '5';
+            }
+            else if (pd->discipline < 0)
+            {
+                return '3';
+            }
+            else if (pd->hunger > 0)
+            {
+                return '1';
+            }
+            else
+            {
+                return '2';
+            }
+        }
+    }
+}
+
+/**
+ * Pick an action for a demon with one of the built in policies
+ *
+ * @param pd     The demon
+ * @param policy The policy to pick with
+ * @return The menu character for the action
+ */
+char getAutoInput(demon_t* pd, policy_t policy)
+{
+    return getPolicyInput(pd, policy);
+}
+
+/**
+ * Helper function to enable auto mode
+ *
+ * @return char
+ */
+char getInput(demon_t* pd)
+{
+    if (autoMode)
+    {
+        return getPolicyInput(pd, autoPolicy);
     }
     else
     {
@@ -754,19 +995,30 @@ char getInput(demon_t* pd)
  */
 bool takeAction(demon_t* pd)
 {
-    PRINT_F("  1. Feed %s\n", pd->name);
-    PRINT_F("  2. Play with %s\n", pd->name);
-    PRINT_F("  3. Discipline %s\n", pd->name);
-    PRINT_F("  4. Give medicine to %s\n", pd->name);
+    PRINT_F("  1. Feed %s\n", demonName(pd));
+    PRINT_F("  2. Play with %s\n", demonName(pd));
+    PRINT_F("  3. Discipline %s\n", demonName(pd));
+    PRINT_F("  4. Give medicine to %s\n", demonName(pd));
     PRINT_F("  5. Scoop a poop\n");
     PRINT_F("  q. Quit\n");
     PRINT_F("  > ");
 
+    // Look ahead in the background while the player decides
+    if (!autoMode)
+    {
+        advisorStart(pd);
+    }
+
     bool invalidInput = true;
     while (invalidInput)
     {
         invalidInput = false;
-        switch (getInput(pd))
+        char input = getInput(pd);
+        if ('\r' != input && '\n' != input)
+        {
+            advisorStop();
+        }
+        switch (input)
         {
             case '1':
             {
@@ -818,172 +1070,947 @@ bool takeAction(demon_t* pd)
 /**
  * @brief Initialize the demon
  *
- * @param pd The demon to initialize
+ * @param pd   The demon to initialize
+ * @param seed The seed for the demon's own RNG
  */
-void resetDemon(demon_t* pd)
+void resetDemon(demon_t* pd, uint64_t seed)
 {
     memset(pd, 0, sizeof(demon_t));
     pd->health = STARTING_HEALTH;
-    namegen(pd->name, sizeof(pd->name) - 1);
-    pd->name[0] -= ('a' - 'A');
+    pd->rng = seed;
+
+    // Names are only ever printed, so don't bother naming demons in auto mode
+    if (!autoMode)
+    {
+        char name[NAME_LEN] = {0};
+        namegen(name, sizeof(name) - 1);
+        name[0] -= ('a' - 'A');
+        pd->nameId = internName(name);
+    }
 
-    PRINT_F("%s fell out of a portal\n", pd->name);
+    PRINT_F("%s fell out of a portal\n", demonName(pd));
 }
 
 /**
- * @brief Dequeue an event
+ * @brief Check if an event queue word is a pointer to a heap queue
  *
- * @param pd
- * @param evt
+ * @param q The demon's evQueue
+ * @return true if it's an evSpill_t*, false if the events are inline
  */
-void enqueueEvt(demon_t* pd, event_t evt)
+static inline bool evqSpilled(uint64_t q)
 {
-    evtCtr[evt]++;
-    if(NULL == pd->evQueue)
+    return 0 != q && 0 == (q & EVQ_INLINE_TAG);
+}
+
+/**
+ * @brief Allocate a heap event queue, or exit if there's no memory, since
+ * dropping events would quietly change the game
+ *
+ * @param cap The number of events it holds, a power of 2
+ * @return The empty queue
+ */
+static evSpill_t* allocSpill(uint32_t cap)
+{
+    double start = evqHeap.timed ? nowSeconds() : 0;
+    evSpill_t* spill = malloc(sizeof(evSpill_t) + cap);
+    if (NULL == spill)
     {
-        pd->evQueue = malloc(sizeof(eventQueue_t));
-        pd->evQueue->event = evt;
-        pd->evQueue->next = NULL;
+        fprintf(stderr, "Out of memory for the event queue\n");
+        exit(1);
     }
-    else
+    spill->head = 0;
+    spill->len = 0;
+    spill->cap = cap;
+    evqHeap.allocs++;
+    if (evqHeap.timed)
     {
-        eventQueue_t* head = pd->evQueue;
-        while(NULL != head->next)
-        {
-            head = head->next;
-        }
-        head->next = malloc(sizeof(eventQueue_t));
-        head->next->event = evt;
-        head->next->next = NULL;
+        evqHeap.seconds += nowSeconds() - start;
     }
+    return spill;
 }
 
 /**
- * @brief Enqueue an event
+ * @brief Free a heap event queue
  *
- * @param pd
- * @return event_t
+ * @param spill The queue
  */
-event_t dequeueEvt(demon_t* pd)
+static void freeSpill(evSpill_t* spill)
 {
-    if(NULL == pd->evQueue)
+    double start = evqHeap.timed ? nowSeconds() : 0;
+    free(spill);
+    evqHeap.frees++;
+    if (evqHeap.timed)
     {
-        return EVT_NONE;
-    }
-    else
-    {
-        event_t ret = pd->evQueue->event;
-        eventQueue_t* toFree = pd->evQueue;
-        pd->evQueue = pd->evQueue->next;
-        free(toFree);
-        return ret;
+        evqHeap.seconds += nowSeconds() - start;
     }
 }
 
 /**
- * Main function, this waits for user input and manages statuses
+ * @brief Copy a demon, including a heap event queue. Forks have to be made
+ * with this rather than by assignment, so they don't share the queue. It's a
+ * plain copy unless the demon has more than EVQ_INLINE events pending
  *
- * @return unused
+ * @param dst The copy, which must not own a heap queue
+ * @param src The demon to copy
  */
-int main(void)
+void copyDemon(demon_t* dst, const demon_t* src)
 {
-    // Seed the RNG
-    srand(time(NULL));
+    *dst = *src;
+    if (evqSpilled(src->evQueue))
+    {
+        const evSpill_t* spill = (const evSpill_t*)(uintptr_t)src->evQueue;
+        evSpill_t* copy = allocSpill(spill->cap);
+        memcpy(copy, spill, sizeof(evSpill_t) + spill->cap);
+        dst->evQueue = (uintptr_t)copy;
+    }
+}
 
-    // Setup a demon for managing
-    demon_t pd;
-    resetDemon(&pd);
+/**
+ * @brief Free what a demon owns besides itself. Only needed for demons which
+ * are thrown away alive, since dying empties the event queue
+ *
+ * @param pd The demon
+ */
+void releaseDemon(demon_t* pd)
+{
+    if (evqSpilled(pd->evQueue))
+    {
+        freeSpill((evSpill_t*)(uintptr_t)pd->evQueue);
+    }
+    pd->evQueue = 0;
+}
 
-    // Set up space to save all the results
-    demon_t autoModeDemons[10000] = {0};
-    uint32_t autoModeResultIdx = 0;
+/**
+ * Perform one action on a demon of a given age, without printing the menu
+ *
+ * @param pd     The demon
+ * @param age    The demon's age
+ * @param action The menu character for the action
+ */
+static ALWAYS_INLINE void doActionAged(demon_t* pd, age_t age, char action)
+{
+    switch (action)
+    {
+        case '1':
+        {
+            feedDemonAged(pd, age);
+            break;
+        }
+        case '2':
+        {
+            playWithDemonAged(pd, age);
+            break;
+        }
+        case '3':
+        {
+            disciplineDemon(pd);
+            break;
+        }
+        case '4':
+        {
+            medicineDemon(pd);
+            break;
+        }
+        case '5':
+        {
+            scoopPoop(pd);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
 
-    bool shouldQuit = false;
-    while (!shouldQuit)
+/**
+ * One action and status update for a demon of a given age with a given policy.
+ * Both are compile time constants in the stage kernels, so every age and
+ * policy branch is folded away
+ *
+ * @param pd     The demon
+ * @param age    The demon's age
+ * @param policy The policy picking the action
+ */
+static ALWAYS_INLINE void tickAged(demon_t* pd, age_t age, policy_t policy)
+{
+    doActionAged(pd, age, getPolicyInput(pd, policy));
+    updateStatusAged(pd, age);
+}
+
+/**
+ * @brief Perform one action on a demon, without printing the menu, tallying
+ * the action or updating its status
+ *
+ * @param pd     The demon
+ * @param action The menu character for the action
+ */
+void doAction(demon_t* pd, char action)
+{
+    doActionAged(pd, pd->age, action);
+}
+
+/**
+ * @brief Perform one action on a demon, then update its status, without
+ * printing the menu or tallying the action
+ *
+ * @param pd     The demon
+ * @param action The menu character for the action
+ */
+void stepDemon(demon_t* pd, char action)
+{
+    doActionAged(pd, pd->age, action);
+    updateStatus(pd);
+}
+
+/**
+ * Define a kernel which ticks a demon until it dies, grows out of an age, or
+ * has run a number of ticks. It returns the number of ticks run
+ */
+#define DEFINE_STAGE_KERNEL(AGE, POLICY)                                        \
+    static uint32_t runStage_##AGE##_##POLICY(demon_t* pd, uint32_t maxTicks)   \
+    {                                                                           \
+        uint32_t ticks = 0;                                                     \
+        while (ticks < maxTicks && pd->health > 0 && (AGE) == pd->age)          \
+        {                                                                       \
+            tickAged(pd, AGE, POLICY);                                          \
+            ticks++;                                                            \
+        }                                                                       \
+        return ticks;                                                           \
+    }
+
+DEFINE_STAGE_KERNEL(AGE_CHILD, POLICY_HEURISTIC)
+DEFINE_STAGE_KERNEL(AGE_TEEN,  POLICY_HEURISTIC)
+DEFINE_STAGE_KERNEL(AGE_ADULT, POLICY_HEURISTIC)
+DEFINE_STAGE_KERNEL(AGE_CHILD, POLICY_RANDOM)
+DEFINE_STAGE_KERNEL(AGE_TEEN,  POLICY_RANDOM)
+DEFINE_STAGE_KERNEL(AGE_ADULT, POLICY_RANDOM)
+DEFINE_STAGE_KERNEL(AGE_CHILD, POLICY_MCTS)
+DEFINE_STAGE_KERNEL(AGE_TEEN,  POLICY_MCTS)
+DEFINE_STAGE_KERNEL(AGE_ADULT, POLICY_MCTS)
+DEFINE_STAGE_KERNEL(AGE_CHILD, POLICY_QTABLE)
+DEFINE_STAGE_KERNEL(AGE_TEEN,  POLICY_QTABLE)
+DEFINE_STAGE_KERNEL(AGE_ADULT, POLICY_QTABLE)
+
+/// Stage kernels, indexed by age then policy
+static uint32_t (*const stageKernels[AGE_NUM_AGES][POLICY_NUM_POLICIES])(demon_t*, uint32_t) =
+{
+    [AGE_CHILD] =
     {
-        if (pd.health > 0)
+        runStage_AGE_CHILD_POLICY_HEURISTIC,
+        runStage_AGE_CHILD_POLICY_RANDOM,
+        runStage_AGE_CHILD_POLICY_MCTS,
+        runStage_AGE_CHILD_POLICY_QTABLE,
+    },
+    [AGE_TEEN] =
+    {
+        runStage_AGE_TEEN_POLICY_HEURISTIC,
+        runStage_AGE_TEEN_POLICY_RANDOM,
+        runStage_AGE_TEEN_POLICY_MCTS,
+        runStage_AGE_TEEN_POLICY_QTABLE,
+    },
+    [AGE_ADULT] =
+    {
+        runStage_AGE_ADULT_POLICY_HEURISTIC,
+        runStage_AGE_ADULT_POLICY_RANDOM,
+        runStage_AGE_ADULT_POLICY_MCTS,
+        runStage_AGE_ADULT_POLICY_QTABLE,
+    },
+};
+
+/**
+ * @brief Tick a demon with the specialized stage kernels until it dies or has
+ * run a number of ticks. The kernel is only picked again when the demon
+ * changes age
+ *
+ * @param pd       The demon
+ * @param policy   The policy picking actions
+ * @param maxTicks The most ticks to run
+ * @return The number of ticks run
+ */
+uint32_t runTicks(demon_t* pd, policy_t policy, uint32_t maxTicks)
+{
+    uint32_t ticks = 0;
+    while (ticks < maxTicks && pd->health > 0)
+    {
+        ticks += stageKernels[pd->age][policy](pd, maxTicks - ticks);
+    }
+    return ticks;
+}
+
+/**
+ * @brief Run a demon's whole life with the specialized stage kernels
+ *
+ * @param pd     The demon, already reset
+ * @param policy The policy picking actions
+ */
+void runLifetime(demon_t* pd, policy_t policy)
+{
+    runTicks(pd, policy, UINT32_MAX);
+}
+
+/**
+ * @brief Run a demon's whole life the same way the interactive loop does, with
+ * auto mode picking actions with autoPolicy
+ *
+ * @param pd The demon, already reset
+ */
+void runLifetimeGeneric(demon_t* pd)
+{
+    while (pd->health > 0)
+    {
+        printStats(pd);
+        takeAction(pd);
+        updateStatus(pd);
+    }
+}
+
+/**
+ * @brief Get a monotonic timestamp
+ *
+ * @return The time in seconds
+ */
+double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Get the number of online CPU cores
+ *
+ * @return The number of cores, at least 1
+ */
+uint32_t numCores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (uint32_t)cores : 1;
+}
+
+/**
+ * @brief Identify the game's rules, so results from different rules can be
+ * told apart. Hashes (FNV-1a) the game constants and SIM_VERSION
+ *
+ * @return The config ID
+ */
+uint32_t configId(void)
+{
+    uint32_t hash = 2166136261u;
+    int32_t version = SIM_VERSION;
+    for (uint32_t c = 0; c <= numGameConstants; c++)
+    {
+        const uint8_t* bytes = (const uint8_t*)((0 == c) ? &version : &gameConstants[c - 1].value);
+        for (size_t i = 0; i < sizeof(int32_t); i++)
         {
-            printStats(&pd);
-            shouldQuit = takeAction(&pd);
-            updateStatus(&pd);
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Time the generic loop against the specialized stage kernels for every
+ * policy, on one thread. Both run from the same seed, so they must produce
+ * identical stats
+ *
+ * @param opts The command line options
+ */
+void runBenchmark(const options_t* opts)
+{
+    batchStats_t* generic = malloc(sizeof(batchStats_t));
+    batchStats_t* specialized = malloc(sizeof(batchStats_t));
+
+    printf("%-10s %14s %14s %8s %s\n", "policy", "generic/s", "specialized/s", "speedup", "identical");
+    for (int p = 0; p < POLICY_NUM_POLICIES; p++)
+    {
+        // Lookahead is far too slow to benchmark a whole batch with, and a Q-table needs training first
+        if (POLICY_MCTS == p || POLICY_QTABLE == p)
+        {
+            continue;
+        }
+
+        statsInit(generic);
+        double start = nowSeconds();
+        runBatch(generic, 0, opts->lifetimes, p, false, opts->seed, 1, NULL, NULL);
+        double genericTime = nowSeconds() - start;
+
+        statsInit(specialized);
+        start = nowSeconds();
+        runBatch(specialized, 0, opts->lifetimes, p, true, opts->seed, 1, NULL, NULL);
+        double specializedTime = nowSeconds() - start;
+
+        bool identical = (0 == memcmp(generic, specialized, sizeof(batchStats_t)));
+        printf("%-10s %14.0f %14.0f %7.2fx %s\n", policyNames[p],
+               opts->lifetimes / genericTime, opts->lifetimes / specializedTime,
+               genericTime / specializedTime, identical ? "yes" : "NO");
+    }
+
+    free(generic);
+    free(specialized);
+}
+
+/**
+ * @brief Parse the command line
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @param opts Where to store the options, already filled with defaults
+ * @return true if the arguments were valid, false if not
+ */
+bool parseArgs(int argc, char** argv, options_t* opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "auto"))
+        {
+            opts->mode = MODE_AUTO;
+        }
+        else if (0 == strcmp(argv[i], "bench"))
+        {
+            opts->mode = MODE_BENCH;
+        }
+        else if (0 == strcmp(argv[i], "train"))
+        {
+            opts->mode = MODE_TRAIN;
+        }
+        else if (0 == strcmp(argv[i], "regress"))
+        {
+            opts->mode = MODE_REGRESS;
+        }
+        else if (0 == strcmp(argv[i], "profile"))
+        {
+            opts->mode = MODE_PROFILE;
+        }
+        else if (0 == strcmp(argv[i], "surrogate") && i + 1 < argc)
+        {
+            opts->mode = MODE_SURROGATE;
+            opts->sweepPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "habitat"))
+        {
+            opts->mode = MODE_HABITAT;
+        }
+        else if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            opts->habitatTicks = strtoul(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(argv[i], "-S") && i + 1 < argc)
+        {
+            opts->sweepPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-N") && i + 1 < argc)
+        {
+            opts->suggestions = strtoul(argv[++i], NULL, 0);
+        }
+        else if (NULL != strchr(argv[i], '=') && opts->numSettings < MAX_SETTINGS)
+        {
+            opts->settings[opts->numSettings++] = argv[i];
+        }
+        else if (0 == strcmp(argv[i], "-A"))
+        {
+            opts->advisor = false;
+        }
+        else if (0 == strcmp(argv[i], "-u"))
+        {
+            opts->updateGolden = true;
+        }
+        else if (0 == strcmp(argv[i], "-G") && i + 1 < argc)
+        {
+            opts->goldenDir = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "split"))
+        {
+            opts->mode = MODE_SPLIT;
+        }
+        else if (0 == strcmp(argv[i], "-e") && i + 1 < argc)
+        {
+            i++;
+            if (0 == strcmp(argv[i], "survive"))
+            {
+                opts->splitEvent = SPLIT_SURVIVE;
+            }
+            else if (0 == strcmp(argv[i], "adult-disciplined"))
+            {
+                opts->splitEvent = SPLIT_ADULT_DISCIPLINED;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-L") && i + 1 < argc)
+        {
+            opts->splitTarget = strtol(argv[++i], NULL, 0);
+            if (opts->splitTarget <= 0)
+            {
+                return false;
+            }
+        }
+        else if (0 == strcmp(argv[i], "merge"))
+        {
+            // Everything after merge is a result file
+            opts->mode = MODE_MERGE;
+            opts->mergeFiles = &argv[i + 1];
+            opts->numMergeFiles = argc - i - 1;
+            return true;
+        }
+        else if (0 == strcmp(argv[i], "-k") && i + 1 < argc)
+        {
+            // Shard spec, k/n
+            char* slash;
+            opts->shardIndex = strtoul(argv[++i], &slash, 0);
+            if ('/' != *slash)
+            {
+                return false;
+            }
+            opts->shardCount = strtoul(slash + 1, NULL, 0);
+            if (opts->shardIndex >= opts->shardCount)
+            {
+                return false;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-o") && i + 1 < argc)
+        {
+            opts->outPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "query"))
+        {
+            // Everything after query is the file, filters and columns
+            opts->mode = MODE_QUERY;
+            opts->queryArgs = &argv[i + 1];
+            opts->numQueryArgs = argc - i - 1;
+            return true;
+        }
+        else if (0 == strcmp(argv[i], "-C") && i + 1 < argc)
+        {
+            opts->cacheDir = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-c") && i + 1 < argc)
+        {
+            opts->columnsPath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-m") && i + 1 < argc)
+        {
+            opts->liveName = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            opts->lifetimes = strtoul(argv[++i], NULL, 0);
+            if (0 == opts->lifetimes)
+            {
+                return false;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-s") && i + 1 < argc)
+        {
+            opts->seed = strtoul(argv[++i], NULL, 0);
+            opts->seeded = true;
+        }
+        else if (0 == strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            opts->threads = strtoul(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(argv[i], "-r") && i + 1 < argc)
+        {
+            opts->rollouts = strtoul(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(argv[i], "-T") && i + 1 < argc)
+        {
+            opts->decisionMs = strtoul(argv[++i], NULL, 0);
+        }
+        else if (0 == strcmp(argv[i], "-q") && i + 1 < argc)
+        {
+            opts->qtablePath = argv[++i];
+        }
+        else if (0 == strcmp(argv[i], "-H") && i + 1 < argc)
+        {
+            opts->horizon = strtoul(argv[++i], NULL, 0);
+            if (0 == opts->horizon)
+            {
+                return false;
+            }
+        }
+        else if (0 == strcmp(argv[i], "-p") && i + 1 < argc)
+        {
+            i++;
+            opts->policy = POLICY_NUM_POLICIES;
+            for (int p = 0; p < POLICY_NUM_POLICIES; p++)
+            {
+                if (0 == strcmp(argv[i], policyNames[p]))
+                {
+                    opts->policy = p;
+                }
+            }
+            if (POLICY_NUM_POLICIES == opts->policy)
+            {
+                return false;
+            }
         }
         else
         {
-            if (autoMode)
+            return false;
+        }
+    }
+
+    // Only surrogate mode predicts at NAME=value, anywhere else it'd be silently ignored
+    return 0 == opts->numSettings || MODE_SURROGATE == opts->mode;
+}
+
+/**
+ * @brief Enqueue an event. Up to EVQ_INLINE events stay in the demon, after
+ * that they all move to a heap queue
+ *
+ * @param pd  The demon
+ * @param evt The event, not EVT_NONE
+ */
+void enqueueEvt(demon_t* pd, event_t evt)
+{
+    evtCtr[evt]++;
+    uint64_t q = pd->evQueue;
+    if (!evqSpilled(q))
+    {
+        // Events are never EVT_NONE, so the highest nibble in use gives the length
+        uint32_t len = (q >> EVQ_EVT_BITS) ? (63 - __builtin_clzll(q)) / EVQ_EVT_BITS : 0;
+        if (len < EVQ_INLINE)
+        {
+            pd->evQueue = q | EVQ_INLINE_TAG | ((uint64_t)evt << ((len + 1) * EVQ_EVT_BITS));
+            return;
+        }
+
+        evSpill_t* spill = allocSpill(EVQ_SPILL_MIN);
+        for (uint32_t i = 0; i < len; i++)
+        {
+            spill->evts[i] = (q >> ((i + 1) * EVQ_EVT_BITS)) & EVQ_EVT_MASK;
+        }
+        spill->len = len;
+        pd->evQueue = (uintptr_t)spill;
+    }
+
+    evSpill_t* spill = (evSpill_t*)(uintptr_t)pd->evQueue;
+    if (spill->len == spill->cap)
+    {
+        // Grow, unwrapping the ring to the start of the new buffer
+        evSpill_t* grown = allocSpill(2 * spill->cap);
+        for (uint32_t i = 0; i < spill->len; i++)
+        {
+            grown->evts[i] = spill->evts[(spill->head + i) & (spill->cap - 1)];
+        }
+        grown->len = spill->len;
+        freeSpill(spill);
+        spill = grown;
+        pd->evQueue = (uintptr_t)spill;
+    }
+    spill->evts[(spill->head + spill->len) & (spill->cap - 1)] = evt;
+    spill->len++;
+}
+
+/**
+ * @brief Dequeue an event. A heap queue moves back inline once it's down to
+ * half of EVQ_INLINE, so a queue hovering at the limit doesn't allocate every tick
+ *
+ * @param pd The demon
+ * @return The oldest event, or EVT_NONE if there are none
+ */
+event_t dequeueEvt(demon_t* pd)
+{
+    uint64_t q = pd->evQueue;
+    if (!evqSpilled(q))
+    {
+        // Shift the next event down into nibble 1, an empty queue gives EVT_NONE
+        pd->evQueue = ((q >> EVQ_EVT_BITS) & ~(uint64_t)EVQ_EVT_MASK) | (q & EVQ_INLINE_TAG);
+        return (q >> EVQ_EVT_BITS) & EVQ_EVT_MASK;
+    }
+
+    evSpill_t* spill = (evSpill_t*)(uintptr_t)q;
+    event_t ret = spill->evts[spill->head];
+    spill->head = (spill->head + 1) & (spill->cap - 1);
+    spill->len--;
+    if (spill->len <= EVQ_INLINE / 2)
+    {
+        q = EVQ_INLINE_TAG;
+        for (uint32_t i = 0; i < spill->len; i++)
+        {
+            q |= (uint64_t)spill->evts[(spill->head + i) & (spill->cap - 1)] << ((i + 1) * EVQ_EVT_BITS);
+        }
+        freeSpill(spill);
+        pd->evQueue = q;
+    }
+    return ret;
+}
+
+/**
+ * Main function, this waits for user input and manages statuses
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return 0 on success, 1 for bad arguments
+ */
+int main(int argc, char** argv)
+{
+    options_t opts =
+    {
+        .mode = MODE_INTERACTIVE,
+        .lifetimes = 10000,
+        .policy = POLICY_HEURISTIC,
+        .seed = time(NULL),
+        .threads = 0,
+        .rollouts = 256,
+        .decisionMs = 0,
+        .horizon = 20,
+        .shardIndex = 0,
+        .shardCount = 1,
+        .splitEvent = SPLIT_SURVIVE,
+        .splitTarget = 500,
+        .goldenDir = "golden",
+        .advisor = true,
+        .suggestions = 5,
+        .habitatTicks = 100,
+    };
+    if (!parseArgs(argc, argv, &opts) || (0 == opts.rollouts && 0 == opts.decisionMs))
+    {
+        printf("usage: %s [auto|bench|train|split|regress|profile|habitat] [-n lifetimes] [-p policy] [-s seed] [-j threads]\n", argv[0]);
+        printf("       [-r rollouts per action] [-T ms per decision] [-H rollout ticks] [-q qtable file]\n");
+        printf("       [-k shard/shards] [-o result file] [-m live stats name] [-e survive|adult-disciplined]\n");
+        printf("       [-L target actions] [-c per-lifetime results file] [-C cache directory]\n");
+        printf("       [-G golden directory] [-u update golden] [-A no advisor] [-S sweep file]\n");
+        printf("       [-t habitat ticks]\n");
+        printf("       %s merge result files...\n", argv[0]);
+        printf("       %s query per-lifetime results file [-w column<op>value]... [columns...]\n", argv[0]);
+        printf("       %s surrogate sweep file [-p policy] [-N suggestions] [CONSTANT=value]...\n", argv[0]);
+        printf("  policies:");
+        for (int p = 0; p < POLICY_NUM_POLICIES; p++)
+        {
+            printf(" %s", policyNames[p]);
+        }
+        printf("\n");
+        return 1;
+    }
+
+    if (opts.shardCount > 1 && !opts.seeded)
+    {
+        printf("Every shard of a run needs the same seed, given with -s\n");
+        return 1;
+    }
+
+    // Seed the RNG, which is only used for names. Each demon has its own RNG
+    srand(opts.seed);
+
+    if (POLICY_MCTS == opts.policy)
+    {
+        mctsInit(opts.threads ? opts.threads : numCores(), opts.rollouts, opts.decisionMs, opts.horizon);
+    }
+    else if (POLICY_QTABLE == opts.policy && MODE_TRAIN != opts.mode)
+    {
+        if (NULL == opts.qtablePath || !qtableLoad(opts.qtablePath))
+        {
+            printf("The qtable policy needs a Q-table from train mode with this build's constants, given with -q\n");
+            return 1;
+        }
+    }
+
+    switch (opts.mode)
+    {
+        case MODE_AUTO:
+        {
+            // Only simulate this shard's share of the lifetimes
+            shardInfo_t shard =
             {
-                // Save the results
-                memcpy(&autoModeDemons[autoModeResultIdx++], &pd, sizeof(pd));
-                resetDemon(&pd);
+                .policy = opts.policy,
+                .seed = opts.seed,
+                .totalLifetimes = opts.lifetimes,
+                .shardIndex = opts.shardIndex,
+                .shardCount = opts.shardCount,
+                .config = configId(),
+            };
+            shardRange(opts.lifetimes, opts.shardIndex, opts.shardCount, &shard.first, &shard.count);
+
+            // Set up space to save all the results
+            batchStats_t* stats = malloc(sizeof(batchStats_t));
+            statsInit(stats);
+            uint32_t threads = (POLICY_MCTS == opts.policy) ? 1 : (opts.threads ? opts.threads : numCores());
+
+            // Take what the cache has, only the rest needs simulating. A per-lifetime
+            // results file needs every row, so then the cache is only written
+            cachePlan_t plan;
+            uint32_t toSimulate = shard.count;
+            if (NULL != opts.cacheDir)
+            {
+                cacheLookup(&plan, &opts, shard.first, shard.count, NULL == opts.columnsPath, stats);
+                toSimulate = plan.missLifetimes;
+            }
 
-                // If all results have been collected
-                if (autoModeResultIdx == lengthof(autoModeDemons))
+            // Publish running totals for demonview while the batch runs
+            liveShared_t* live = NULL;
+            if (NULL != opts.liveName)
+            {
+                live = liveCreate(opts.liveName, threads, toSimulate, policyNames[opts.policy], demonStatNames,
+                                  evtNames, nowSeconds());
+                if (NULL == live && EEXIST == errno)
                 {
-                    // Find the average for all stats
-                    int32_t len = lengthof(autoModeDemons);
-                    demon_t avgDemon = {0};
-                    for (uint32_t i = 0; i < lengthof(autoModeDemons); i++)
+                    printf("Live stats name %s is already in use, pick another one\n", opts.liveName);
+                    if (NULL != opts.cacheDir)
                     {
-                        avgDemon.hunger += autoModeDemons[i].hunger;
-                        avgDemon.happy += autoModeDemons[i].happy;
-                        avgDemon.discipline += autoModeDemons[i].discipline;
-                        avgDemon.health += autoModeDemons[i].health;
-                        avgDemon.poopCount += autoModeDemons[i].poopCount;
-                        avgDemon.actionsTaken += autoModeDemons[i].actionsTaken;
+                        cacheFree(&plan);
                     }
-                    avgDemon.hunger /= len;
-                    avgDemon.happy /= len;
-                    avgDemon.discipline /= len;
-                    avgDemon.health /= len;
-                    avgDemon.poopCount /= len;
-                    avgDemon.actionsTaken /= len;
-
-                    // Find the standard deviation for all stats
-                    demon_t stdevDemon = {0};
-                    for (uint32_t i = 0; i < lengthof(autoModeDemons); i++)
-                    {
-                        stdevDemon.hunger += SQUARE(autoModeDemons[i].hunger - avgDemon.hunger);
-                        stdevDemon.happy += SQUARE(autoModeDemons[i].happy - avgDemon.happy);
-                        stdevDemon.discipline += SQUARE(autoModeDemons[i].discipline - avgDemon.discipline);
-                        stdevDemon.health += SQUARE(autoModeDemons[i].health - avgDemon.health);
-                        stdevDemon.poopCount += SQUARE(autoModeDemons[i].poopCount - avgDemon.poopCount);
-                        stdevDemon.actionsTaken += SQUARE(autoModeDemons[i].actionsTaken - avgDemon.actionsTaken);
-                    }
-                    stdevDemon.hunger = sqrt(stdevDemon.hunger / len);
-                    stdevDemon.happy = sqrt(stdevDemon.happy / len);
-                    stdevDemon.discipline = sqrt(stdevDemon.discipline / len);
-                    stdevDemon.health = sqrt(stdevDemon.health / len);
-                    stdevDemon.poopCount = sqrt(stdevDemon.poopCount / len);
-                    stdevDemon.actionsTaken = sqrt(stdevDemon.actionsTaken / len);
-
-                    // Print everything
-                    printf("             %4s %4s\n", "Avg", "Std");
-                    printf("hunger       %4d %4d\n", avgDemon.hunger,       stdevDemon.hunger);
-                    printf("happy        %4d %4d\n", avgDemon.happy,        stdevDemon.happy);
-                    printf("discipline   %4d %4d\n", avgDemon.discipline,   stdevDemon.discipline);
-                    printf("health       %4d %4d\n", avgDemon.health,       stdevDemon.health);
-                    printf("poopCount    %4d %4d\n", avgDemon.poopCount,    stdevDemon.poopCount);
-                    printf("actionsTaken %4d %4d\n", avgDemon.actionsTaken, stdevDemon.actionsTaken);
-
-                    printf("\n");
-                    printf("%-25s %3.2f\n", "EVT_GOT_SICK_RANDOMLY", evtCtr[EVT_GOT_SICK_RANDOMLY] / (float)len);
-                    printf("%-25s %3.2f\n", "EVT_GOT_SICK_POOP", evtCtr[EVT_GOT_SICK_POOP] / (float)len);
-                    printf("%-25s %3.2f\n", "EVT_GOT_SICK_OBESE", evtCtr[EVT_GOT_SICK_OBESE] / (float)len);
-                    printf("%-25s %3.2f\n", "EVT_GOT_SICK_MALNOURISHED", evtCtr[EVT_GOT_SICK_MALNOURISHED] / (float)len);
-                    printf("%-25s %3.2f\n", "EVT_POOPED", evtCtr[EVT_POOPED] / (float)len);
-                    printf("%-25s %3.2f\n", "EVT_LOST_DISCIPLINE", evtCtr[EVT_LOST_DISCIPLINE] / (float)len);
-
-                    printf("\nPress enter to quit\n");
-                    getchar();
-                    return 0;
+                    free(stats);
+                    return 1;
                 }
+                else if (NULL == live)
+                {
+                    printf("Couldn't create live stats %s, running without them\n", opts.liveName);
+                }
+                else
+                {
+                    printf("Live stats at %s, watch with demonview.exe %s\n", opts.liveName, opts.liveName);
+                }
+                fflush(stdout);
+            }
+            // Every lifetime's final stats can be kept too
+            colWriter_t* columns = NULL;
+            if (NULL != opts.columnsPath && NULL == (columns = colWriterOpen(opts.columnsPath)))
+            {
+                printf("Couldn't create %s\n", opts.columnsPath);
+                if (NULL != opts.cacheDir)
+                {
+                    cacheFree(&plan);
+                }
+                free(stats);
+                liveFinish(live, opts.liveName);
+                return 1;
+            }
+
+            if (NULL != opts.cacheDir)
+            {
+                cacheRun(&plan, &opts, stats, threads, live, columns);
             }
             else
             {
-                PRINT_F("Press enter to quit\n");
-                getchar();
-                shouldQuit = true;
+                runBatch(stats, shard.first, shard.count, opts.policy, true, opts.seed, threads, live, columns);
+            }
+            liveFinish(live, opts.liveName);
+            mctsDeinit();
+            bool columnsWritten = colWriterClose(columns);
+
+            if (opts.shardCount > 1)
+            {
+                printf("shard %u of %u, lifetimes %u to %u\n\n", opts.shardIndex, opts.shardCount, shard.first,
+                       shard.first + shard.count - 1);
+            }
+            printStatsReport(stats);
+            if (NULL != opts.cacheDir)
+            {
+                printf("\n");
+                cacheReport(&plan);
+                cacheFree(&plan);
+            }
+
+            int ret = 0;
+            if (NULL != opts.columnsPath)
+            {
+                printf("\nPer-lifetime results %s %s\n", columnsWritten ? "written to" : "couldn't be written to",
+                       opts.columnsPath);
+                ret = columnsWritten ? ret : 1;
+            }
+            if (NULL != opts.outPath)
+            {
+                if (writeResultFile(opts.outPath, &shard, stats))
+                {
+                    printf("\nResults written to %s\n", opts.outPath);
+                }
+                else
+                {
+                    printf("\nCouldn't write results to %s\n", opts.outPath);
+                    ret = 1;
+                }
+            }
+            if (NULL != opts.sweepPath)
+            {
+                if (sweepAppend(opts.sweepPath, stats, opts.policy, opts.seed))
+                {
+                    printf("\nOutcomes added to the sweep %s\n", opts.sweepPath);
+                }
+                else
+                {
+                    printf("\nCouldn't add the outcomes to the sweep %s\n", opts.sweepPath);
+                    ret = 1;
+                }
             }
+            free(stats);
+            return ret;
+        }
+        case MODE_BENCH:
+        {
+            runBenchmark(&opts);
+            return 0;
+        }
+        case MODE_TRAIN:
+        {
+            return qlearnTrain(&opts);
+        }
+        case MODE_SPLIT:
+        {
+            return runSplitting(&opts);
+        }
+        case MODE_MERGE:
+        {
+            return mergeResultFiles(opts.mergeFiles, opts.numMergeFiles);
+        }
+        case MODE_REGRESS:
+        {
+            return runRegression(&opts);
+        }
+        case MODE_HABITAT:
+        {
+            return runHabitat(&opts);
+        }
+        case MODE_SURROGATE:
+        {
+            return runSurrogate(&opts);
+        }
+        case MODE_PROFILE:
+        {
+            return runProfile(&opts);
+        }
+        case MODE_QUERY:
+        {
+            return runQuery(opts.queryArgs, opts.numQueryArgs);
+        }
+        default:
+        case MODE_INTERACTIVE:
+        {
+            break;
+        }
+    }
+
+    // Setup a demon for managing
+    demon_t pd;
+    resetDemon(&pd, opts.seed);
+
+    // The advice is drawn over the menu, which only works on a terminal
+    if (opts.advisor && isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+    {
+        advisorInit(opts.threads ? opts.threads : numCores(), opts.horizon);
+    }
+
+    bool shouldQuit = false;
+    while (!shouldQuit)
+    {
+        if (pd.health > 0)
+        {
+            printStats(&pd);
+            shouldQuit = takeAction(&pd);
+            updateStatus(&pd);
+        }
+        else
+        {
+            PRINT_F("Press enter to quit\n");
+            getchar();
+            shouldQuit = true;
         }
     }
+    releaseDemon(&pd);
+    advisorDeinit();
     return 0;
 }
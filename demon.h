@@ -0,0 +1,406 @@
+#ifndef _DEMON_H_
+#define _DEMON_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <math.h>
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define lengthof(x) (sizeof(x) / sizeof(x[0]))
+
+#define SQUARE(x) ((x)*(x))
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+#define PRINT_F(...) do{if(!autoMode){printf(__VA_ARGS__);}}while(false)
+#define TALLY_ACTION() do{if(!autoMode){static int t=0; t++; printf("\n    %s() %d times\n", __func__, t);}}while(false)
+
+#define INC_BOUND(base, inc, lbound, ubound) \
+    do{                                      \
+        if (base + inc > ubound) {           \
+            base = ubound;                   \
+        } else if (base + inc < lbound) {    \
+            base = lbound;                   \
+        } else {                             \
+            base += inc;                     \
+        }                                    \
+    } while(false)
+
+#define STOMACH_SIZE 5 // Max number of foods being digested
+
+// The stomach is packed as one 4-bit digest timer per food, lowest nibble first
+#define STOMACH_NIBBLE_BITS 4
+#define STOMACH_NIBBLE_MASK 0xF
+#define STOMACH_NIBBLE_LSBS 0x11111u ///< The low bit of every nibble in the stomach
+
+#define NAME_LEN 32 ///< Max length of a demon's name, including the terminator
+
+#define MAX_SETTINGS 32 ///< NAME=value arguments surrogate mode takes
+
+// The event queue is one word. It holds up to EVQ_INLINE 4-bit event_t in
+// nibbles 1 and up, oldest first, with EVQ_INLINE_TAG set. Long lives outgrow
+// that, and then the word is a pointer to a heap queue (evSpill_t) the demon
+// owns, which is why demons are copied with copyDemon(). Heap pointers are
+// aligned, so their low bit is never the tag. 0 is an empty queue
+#define EVQ_INLINE     15
+#define EVQ_INLINE_TAG 1
+#define EVQ_EVT_BITS   4
+#define EVQ_EVT_MASK   0xF
+
+// The balance constants can be overridden when building, e.g. for a sweep:
+// make DEFS="-DHAPPINESS_GAINED_PER_GAME=6"
+
+// Every action modifies hunger somehow
+#ifndef HUNGER_LOST_PER_FEEDING
+#define HUNGER_LOST_PER_FEEDING    5 ///< Hunger is lost when feeding
+#endif
+#ifndef HUNGER_GAINED_PER_PLAY
+#define HUNGER_GAINED_PER_PLAY     3 ///< Hunger is gained when playing
+#endif
+#ifndef HUNGER_GAINED_PER_SCOLD
+#define HUNGER_GAINED_PER_SCOLD    1 ///< Hunger is gained when being scolded
+#endif
+#ifndef HUNGER_GAINED_PER_MEDICINE
+#define HUNGER_GAINED_PER_MEDICINE 1 ///< Hunger is gained when taking medicine
+#endif
+#ifndef HUNGER_GAINED_PER_FLUSH
+#define HUNGER_GAINED_PER_FLUSH    1 ///< Hunger is gained when flushing
+#endif
+
+#ifndef OBESE_THRESHOLD
+#define OBESE_THRESHOLD        -6 ///< too fat (i.e. not hungry)
+#endif
+#ifndef MALNOURISHED_THRESHOLD
+#define MALNOURISHED_THRESHOLD  6 ///< too skinny (i.e. hungry)
+#endif
+
+#ifndef HAPPINESS_GAINED_PER_GAME
+#define HAPPINESS_GAINED_PER_GAME                4 ///< Playing games increases happiness
+#endif
+#ifndef HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY
+#define HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY 1 ///< Eating when hungry increases happiness
+#endif
+#ifndef HAPPINESS_LOST_PER_FEEDING_WHEN_FULL
+#define HAPPINESS_LOST_PER_FEEDING_WHEN_FULL     3 ///< Eating when full decreases happiness
+#endif
+#ifndef HAPPINESS_LOST_PER_MEDICINE
+#define HAPPINESS_LOST_PER_MEDICINE              4 ///< Taking medicine makes decreases happiness
+#endif
+#ifndef HAPPINESS_LOST_PER_STANDING_POOP
+#define HAPPINESS_LOST_PER_STANDING_POOP         5 ///< Being around poop decreases happiness
+#endif
+#ifndef HAPPINESS_LOST_PER_SCOLDING
+#define HAPPINESS_LOST_PER_SCOLDING              6 ///< Scolding decreases happiness
+#endif
+
+// TODO once a demon gets unruly, its hard to get it back on track, cascading effect. unruly->refuse stuff->unhappy->unruly
+#ifndef DISCIPLINE_GAINED_PER_SCOLDING
+#define DISCIPLINE_GAINED_PER_SCOLDING 4 ///< Scolding increases discipline
+#endif
+#ifndef DISCIPLINE_LOST_RANDOMLY
+#define DISCIPLINE_LOST_RANDOMLY       2 ///< Discipline is randomly lost
+#endif
+
+#ifndef STARTING_HEALTH
+#define STARTING_HEALTH          20 ///< Health is started with, cannot be increased
+#endif
+#ifndef HEALTH_LOST_PER_SICKNESS
+#define HEALTH_LOST_PER_SICKNESS  1 ///< Health is lost every turn while sick
+#endif
+#ifndef HEALTH_LOST_PER_OBE_MAL
+#define HEALTH_LOST_PER_OBE_MAL   2 ///< Health is lost every turn while obese or malnourished
+#endif
+
+#ifndef ACTIONS_UNTIL_TEEN
+#define ACTIONS_UNTIL_TEEN  33
+#endif
+#ifndef ACTIONS_UNTIL_ADULT
+#define ACTIONS_UNTIL_ADULT 66
+#endif
+
+// Overrides must fit the demon_t field each constant is added to or compared with
+#define CONSTANT_FITS(name, lo, hi, field) \
+    _Static_assert((name) >= (lo) && (name) <= (hi), #name " doesn't fit in demon_t." field)
+CONSTANT_FITS(HUNGER_LOST_PER_FEEDING,    INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(HUNGER_GAINED_PER_PLAY,     INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(HUNGER_GAINED_PER_SCOLD,    INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(HUNGER_GAINED_PER_MEDICINE, INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(HUNGER_GAINED_PER_FLUSH,    INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(OBESE_THRESHOLD,            INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(MALNOURISHED_THRESHOLD,     INT8_MIN, INT8_MAX, "hunger");
+CONSTANT_FITS(HAPPINESS_GAINED_PER_GAME,                INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(HAPPINESS_GAINED_PER_FEEDING_WHEN_HUNGRY, INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(HAPPINESS_LOST_PER_FEEDING_WHEN_FULL,     INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(HAPPINESS_LOST_PER_MEDICINE,              INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(HAPPINESS_LOST_PER_STANDING_POOP,         INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(HAPPINESS_LOST_PER_SCOLDING,              INT16_MIN, INT16_MAX, "happy");
+CONSTANT_FITS(DISCIPLINE_GAINED_PER_SCOLDING, INT8_MIN, INT8_MAX, "discipline");
+CONSTANT_FITS(3 * DISCIPLINE_LOST_RANDOMLY,   INT8_MIN, INT8_MAX, "discipline");
+CONSTANT_FITS(STARTING_HEALTH,          1,        INT8_MAX, "health");
+CONSTANT_FITS(HEALTH_LOST_PER_SICKNESS, INT8_MIN, INT8_MAX, "health");
+CONSTANT_FITS(HEALTH_LOST_PER_OBE_MAL,  INT8_MIN, INT8_MAX, "health");
+CONSTANT_FITS(ACTIONS_UNTIL_TEEN,  0, INT16_MAX, "actionsTaken");
+CONSTANT_FITS(ACTIONS_UNTIL_ADULT, 0, INT16_MAX, "actionsTaken");
+
+#define SIM_VERSION 2 ///< Bump when the rules change in a way the constants above don't show
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+typedef enum
+{
+    EVT_NONE,
+    EVT_GOT_SICK_RANDOMLY,
+    EVT_GOT_SICK_POOP,
+    EVT_GOT_SICK_OBESE,
+    EVT_GOT_SICK_MALNOURISHED,
+    EVT_POOPED,
+    EVT_LOST_DISCIPLINE,
+    EVT_NUM_EVENTS,
+} event_t;
+
+typedef enum
+{
+    AGE_CHILD,
+    AGE_TEEN,
+    AGE_ADULT,
+    AGE_NUM_AGES,
+} age_t;
+
+/// Built in policies for picking actions in auto mode
+typedef enum
+{
+    POLICY_HEURISTIC, ///< Fix the most pressing problem first
+    POLICY_RANDOM,    ///< Pick any action, as a baseline
+    POLICY_MCTS,      ///< Look ahead with Monte Carlo rollouts of every action
+    POLICY_QTABLE,    ///< Follow a Q-table learned with the train mode
+    POLICY_NUM_POLICIES,
+} policy_t;
+
+typedef enum
+{
+    MODE_INTERACTIVE,
+    MODE_AUTO,
+    MODE_BENCH,
+    MODE_TRAIN,
+    MODE_MERGE,
+    MODE_SPLIT,
+    MODE_QUERY,
+    MODE_REGRESS,
+    MODE_PROFILE,
+    MODE_SURROGATE,
+    MODE_HABITAT,
+} runMode_t;
+
+/// Rare outcomes split mode can estimate
+typedef enum
+{
+    SPLIT_SURVIVE,           ///< Still alive after a number of actions
+    SPLIT_ADULT_DISCIPLINED, ///< Becomes an adult with positive discipline
+} splitEvent_t;
+
+/// The stats which are reported for a demon's lifetime
+typedef enum
+{
+    DSTAT_HUNGER,
+    DSTAT_HAPPY,
+    DSTAT_DISCIPLINE,
+    DSTAT_HEALTH,
+    DSTAT_POOP_COUNT,
+    DSTAT_ACTIONS_TAKEN,
+    DSTAT_NUM_STATS,
+} demonStat_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// A demon's event queue once it's too long to keep inline
+typedef struct evSpill evSpill_t;
+
+/**
+ * The hot simulation state of a demon. Fields are as narrow as their range
+ * allows so that large populations stay cache resident. Anything only needed
+ * for printing, like the name, lives in a cold table instead.
+ */
+typedef struct
+{
+    uint64_t rng;     ///< This demon's own random number generator state
+    uint64_t evQueue; ///< Pending event_t inline, or an evSpill_t*, see EVQ_INLINE
+    int16_t happy;
+    int16_t actionsTaken;
+    uint32_t stomach; ///< STOMACH_SIZE nibbles, each one a food's remaining digest time
+    int8_t hunger; ///< 0 hunger is perfect, positive means too hungry, negative means too full
+    int8_t discipline;
+    int8_t health;
+    int8_t poopCount;
+    uint8_t age;      ///< An age_t
+    bool isSick;
+    uint16_t nameId;  ///< Index into the interned name table, 0 is unnamed
+} demon_t;
+
+_Static_assert(sizeof(demon_t) <= 32, "Two demons should fit in a cache line");
+
+/// Heap event queue traffic on one thread, which profile mode reports
+typedef struct
+{
+    uint64_t allocs;
+    uint64_t frees;
+    double seconds; ///< Time spent allocating and freeing, only measured when timed
+    bool timed;
+} evqHeap_t;
+
+/// A game constant and its value in this build
+typedef struct
+{
+    const char* name;
+    int32_t value;
+} gameConstant_t;
+
+/// Command line options
+typedef struct
+{
+    runMode_t mode;
+    uint32_t lifetimes; ///< The number of demons to simulate in auto or bench mode
+    policy_t policy;
+    uint32_t seed;
+    bool seeded;            ///< Whether -s gave the seed, rather than it being random
+    uint32_t threads;       ///< Worker threads, 0 for one per core
+    uint32_t rollouts;      ///< Lookahead rollouts per action per decision, 0 for no limit
+    uint32_t decisionMs;    ///< Lookahead time per decision, 0 for no limit
+    uint32_t horizon;       ///< Lookahead ticks per rollout
+    const char* qtablePath; ///< Q-table written by train mode and read by the qtable policy
+    uint32_t shardIndex;    ///< Which shard of the lifetimes to simulate
+    uint32_t shardCount;    ///< How many shards the lifetimes are split into
+    const char* outPath;    ///< Result file for auto mode
+    const char* liveName;   ///< Shared memory name auto mode publishes live stats under
+    const char* columnsPath; ///< Per-lifetime results file for auto mode
+    const char* cacheDir;   ///< Where auto mode caches results, NULL for no cache
+    const char* goldenDir;  ///< Where regress mode's golden summaries are
+    bool updateGolden;      ///< Regress mode stores new golden summaries instead of checking
+    bool advisor;           ///< Interactive mode shows rollout advice next to the menu
+    const char* sweepPath;  ///< Sweep file auto mode adds its outcomes to and surrogate mode fits
+    const char* settings[MAX_SETTINGS]; ///< Constants surrogate mode predicts at, as NAME=value
+    int numSettings;
+    uint32_t suggestions;   ///< Points surrogate mode suggests simulating next
+    uint32_t habitatTicks;  ///< Ticks habitat mode runs each population for
+    char** queryArgs;       ///< The file, filters and columns for query mode
+    int numQueryArgs;
+    char** mergeFiles;      ///< Result files for merge mode
+    int numMergeFiles;
+    splitEvent_t splitEvent; ///< The rare outcome for split mode
+    int32_t splitTarget;     ///< Actions to survive for SPLIT_SURVIVE
+} options_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void namegen(char* name, int namelen);
+uint32_t internName(const char* name);
+const char* demonName(const demon_t* pd);
+bool eatFood(demon_t* pd);
+void feedDemon(demon_t* pd);
+void playWithDemon(demon_t* pd);
+void disciplineDemon(demon_t* pd);
+bool disciplineCheck(demon_t* pd);
+void medicineDemon(demon_t* pd);
+void scoopPoop(demon_t* pd);
+void updateStatus(demon_t* pd);
+void printStats(demon_t* pd);
+int32_t getDemonStat(const demon_t* pd, demonStat_t stat);
+char getAutoInput(demon_t* pd, policy_t policy);
+char getInput(demon_t* pd);
+bool takeAction(demon_t* pd);
+void resetDemon(demon_t* pd, uint64_t seed);
+void copyDemon(demon_t* dst, const demon_t* src);
+void releaseDemon(demon_t* pd);
+void doAction(demon_t* pd, char action);
+void stepDemon(demon_t* pd, char action);
+
+uint32_t runTicks(demon_t* pd, policy_t policy, uint32_t maxTicks);
+void runLifetime(demon_t* pd, policy_t policy);
+void runLifetimeGeneric(demon_t* pd);
+void runBenchmark(const options_t* opts);
+bool parseArgs(int argc, char** argv, options_t* opts);
+double nowSeconds(void);
+uint32_t numCores(void);
+uint32_t configId(void);
+
+event_t dequeueEvt(demon_t* pd);
+void enqueueEvt(demon_t* pd, event_t evt);
+
+/*******************************************************************************
+ * Externs
+ ******************************************************************************/
+
+extern _Thread_local uint32_t evtCtr[EVT_NUM_EVENTS];
+extern _Thread_local bool autoMode;
+extern _Thread_local evqHeap_t evqHeap;
+extern policy_t autoPolicy;
+extern const char* policyNames[POLICY_NUM_POLICIES];
+extern const char* demonStatNames[DSTAT_NUM_STATS];
+extern const char* evtNames[EVT_NUM_EVENTS];
+extern const gameConstant_t gameConstants[];
+extern const uint32_t numGameConstants;
+
+/*******************************************************************************
+ * Inline Functions
+ ******************************************************************************/
+
+/**
+ * @brief Derive an independent RNG seed for a numbered stream of a base seed
+ * (splitmix64 finalizer)
+ *
+ * @param seed   The base seed
+ * @param stream The stream number, e.g. a lifetime index
+ * @return The derived seed
+ */
+static inline uint64_t mixSeed(uint64_t seed, uint64_t stream)
+{
+    uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Get a random number from an RNG state (splitmix64). Like rand(), the
+ * result is between 0 and INT32_MAX
+ *
+ * @param state The RNG state
+ * @return The random number
+ */
+static inline int32_t rngNext(uint64_t* state)
+{
+    *state += 0x9E3779B97F4A7C15ull;
+    uint64_t z = *state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return (int32_t)((z ^ (z >> 31)) >> 33);
+}
+
+/**
+ * @brief Get a random number from a demon's own RNG
+ *
+ * @param pd The demon
+ * @return The random number, between 0 and INT32_MAX
+ */
+static inline int32_t demonRand(demon_t* pd)
+{
+    return rngNext(&pd->rng);
+}
+
+#endif
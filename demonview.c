@@ -0,0 +1,168 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "live.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define VIEW_DEFAULT_MS 1000
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Get a monotonic timestamp, in the same clock as the simulator's
+ * nowSeconds()
+ *
+ * @return Seconds since an arbitrary point
+ */
+static double viewSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Sleep for some milliseconds
+ *
+ * @param ms The milliseconds
+ */
+static void viewSleep(uint32_t ms)
+{
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Print one refresh of a run's live stats
+ *
+ * @param live     The segment
+ * @param totals   The totals just read
+ * @param prev     The totals at the last refresh
+ * @param interval Seconds since the last refresh
+ */
+static void viewPrint(const liveShared_t* live, const liveTotals_t* totals, const liveTotals_t* prev,
+                      double interval)
+{
+    double elapsed = viewSeconds() - live->startTime;
+    uint64_t ticks = totals->sum[DSTAT_ACTIONS_TAKEN];
+    uint64_t prevTicks = prev->sum[DSTAT_ACTIONS_TAKEN];
+    double lifetimeRate = (totals->lifetimes - prev->lifetimes) / interval;
+    double tickRate = (ticks - prevTicks) / interval;
+
+    printf("pid %u, policy %s, %u threads, %.1fs\n", live->pid, live->policy, live->numSlots, elapsed);
+    printf("%llu of %llu lifetimes (%.1f%%)", (unsigned long long)totals->lifetimes,
+           (unsigned long long)live->totalLifetimes, 100.0 * totals->lifetimes / live->totalLifetimes);
+    if (lifetimeRate > 0)
+    {
+        printf(", ~%.0fs left", (live->totalLifetimes - totals->lifetimes) / lifetimeRate);
+    }
+    printf("\n%.0f lifetimes/s, %.0f ticks/s now, %.0f ticks/s overall\n\n", lifetimeRate, tickRate,
+           elapsed > 0 ? ticks / elapsed : 0);
+
+    if (0 == totals->lifetimes)
+    {
+        return;
+    }
+    printf("%-12s %8s\n", "stat", "mean");
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        printf("%-12s %8.2f\n", live->statNames[s], totals->sum[s] / (double)totals->lifetimes);
+    }
+    printf("\n%-25s %8s\n", "event", "per life");
+    for (int e = EVT_NONE + 1; e < EVT_NUM_EVENTS; e++)
+    {
+        printf("%-25s %8.2f\n", live->evtNames[e], totals->evtCount[e] / (double)totals->lifetimes);
+    }
+}
+
+/**
+ * Attach to a running auto mode simulation's live stats and show them until it
+ * finishes
+ *
+ * @param argc The number of arguments
+ * @param argv The arguments
+ * @return 0 when the run finished, 1 for bad arguments or if it went away
+ */
+int main(int argc, char** argv)
+{
+    const char* name = NULL;
+    uint32_t intervalMs = VIEW_DEFAULT_MS;
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-i") && i + 1 < argc)
+        {
+            intervalMs = strtoul(argv[++i], NULL, 0);
+        }
+        else if (NULL == name)
+        {
+            name = argv[i];
+        }
+        else
+        {
+            name = NULL;
+            break;
+        }
+    }
+    if (NULL == name || 0 == intervalMs)
+    {
+        printf("usage: %s live stats name [-i ms between refreshes]\n", argv[0]);
+        printf("  the name is the one given to demon.exe auto -m\n");
+        return 1;
+    }
+
+    // The run may not have started yet
+    liveShared_t* live;
+    bool waiting = false;
+    while (NULL == (live = liveAttach(name)))
+    {
+        if (!waiting)
+        {
+            printf("Waiting for %s\n", name);
+            fflush(stdout);
+            waiting = true;
+        }
+        viewSleep(intervalMs);
+    }
+
+    // Redraw in place on a terminal, otherwise append each refresh
+    bool redraw = isatty(STDOUT_FILENO);
+    liveTotals_t prev;
+    liveTotals_t totals;
+    liveRead(live, &prev);
+    double last = viewSeconds();
+    int ret = 0;
+    bool done = false;
+    while (!done)
+    {
+        viewSleep(intervalMs);
+        done = (LIVE_DONE == atomic_load_explicit((atomic_uint*)&live->state, memory_order_acquire));
+        liveRead(live, &totals);
+        double now = viewSeconds();
+
+        printf(redraw ? "\033[H\033[J" : "\n");
+        viewPrint(live, &totals, &prev, now - last);
+        fflush(stdout);
+        prev = totals;
+        last = now;
+
+        // A killed run never marks itself done
+        if (!done && 0 != kill(live->pid, 0) && ESRCH == errno)
+        {
+            printf("\nThe run went away before finishing\n");
+            ret = 1;
+            break;
+        }
+    }
+    liveDetach(live);
+    return ret;
+}
@@ -0,0 +1,313 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+
+#include "habitat.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define HABITAT_CONTAGION_ODDS 16   ///< 1 in this chance per sick neighbour per tick of catching it
+#define HABITAT_POOP_ODDS      32   ///< 1 in this chance per neighbour with poop per tick of getting sick
+#define HABITAT_SICK           0x80 ///< Exposure bit for a sick demon, the rest is its poop count
+#define HABITAT_MIN_POPULATION 1024 ///< Smallest population a run measures
+#define HABITAT_SIZES          4    ///< Populations a run measures, each a quarter of the last
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+typedef struct habitat habitat_t;
+
+/**
+ * A band of rows of the habitat, owned by one thread. Neighbours only see each
+ * other through the exposure grids, one byte per demon, so the demons themselves
+ * never leave their band. The exposure grid has a halo row above and below the
+ * band, which the bands on either side write their edge rows into
+ */
+typedef struct
+{
+    habitat_t* habitat;
+    pthread_t thread;
+    uint32_t index;
+    uint32_t firstRow;
+    uint32_t numRows;
+    demon_t* demons;      ///< numRows by the habitat's width
+    uint8_t* exposure[2]; ///< numRows + 2 by the width. Tick t reads [t & 1] and writes the other
+    uint64_t births;      ///< Dead demons replaced
+    uint64_t contagions;  ///< Sicknesses caught from sick neighbours
+    uint64_t poopSick;    ///< Sicknesses from neighbours' poop
+    uint64_t sick;        ///< Demons sick after the last tick
+    uint64_t check;       ///< Sum of every demon's final RNG state
+} habitatPart_t;
+
+/// A torus of demons, each one a neighbour of the four around it
+struct habitat
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t ticks;
+    policy_t policy;
+    uint64_t seed;
+    uint32_t numParts;
+    habitatPart_t* parts;
+    pthread_barrier_t barrier;
+};
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Get what a demon exposes its neighbours to
+ *
+ * @param pd The demon
+ * @return HABITAT_SICK if it's sick, ORed with its poop count
+ */
+static inline uint8_t habitatExposure(const demon_t* pd)
+{
+    uint8_t poop = (pd->poopCount > 0) ? (uint8_t)pd->poopCount : 0;
+    return (pd->isSick ? HABITAT_SICK : 0) | (poop & ~HABITAT_SICK);
+}
+
+/**
+ * @brief Copy a band's edge rows into the halos of the bands above and below
+ *
+ * @param part     The band
+ * @param exposure Which exposure grid, 0 or 1
+ */
+static void habitatPushHalos(habitatPart_t* part, int exposure)
+{
+    habitat_t* h = part->habitat;
+    habitatPart_t* above = &h->parts[(part->index + h->numParts - 1) % h->numParts];
+    habitatPart_t* below = &h->parts[(part->index + 1) % h->numParts];
+    const uint8_t* grid = part->exposure[exposure];
+    memcpy(&above->exposure[exposure][(above->numRows + 1) * h->width], &grid[h->width], h->width);
+    memcpy(&below->exposure[exposure][0], &grid[part->numRows * h->width], h->width);
+}
+
+/**
+ * @brief Habitat worker thread. Allocates its band, so the memory is local to
+ * the thread that ticks it, then ticks it in step with the other bands. Each
+ * demon only reads its neighbours' exposure from the last tick and only draws
+ * from its own RNG, so the results don't depend on how the habitat is split
+ *
+ * @param arg The habitatPart_t
+ * @return NULL
+ */
+static void* habitatWorker(void* arg)
+{
+    habitatPart_t* part = arg;
+    habitat_t* h = part->habitat;
+    uint32_t w = h->width;
+    autoMode = true;
+
+    part->demons = malloc((size_t)part->numRows * w * sizeof(demon_t));
+    part->exposure[0] = malloc((size_t)(part->numRows + 2) * w);
+    part->exposure[1] = malloc((size_t)(part->numRows + 2) * w);
+    for (uint32_t r = 0; r < part->numRows; r++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+        {
+            demon_t* pd = &part->demons[r * w + x];
+            resetDemon(pd, mixSeed(h->seed, (uint64_t)(part->firstRow + r) * w + x));
+            part->exposure[0][(r + 1) * w + x] = habitatExposure(pd);
+        }
+    }
+
+    // Every band has to exist before any halos can be pushed into it
+    pthread_barrier_wait(&h->barrier);
+    habitatPushHalos(part, 0);
+    pthread_barrier_wait(&h->barrier);
+
+    for (uint32_t t = 0; t < h->ticks; t++)
+    {
+        const uint8_t* cur = part->exposure[t & 1];
+        uint8_t* next = part->exposure[(t + 1) & 1];
+        for (uint32_t r = 0; r < part->numRows; r++)
+        {
+            const uint8_t* above = &cur[r * w];
+            const uint8_t* here = &cur[(r + 1) * w];
+            const uint8_t* below = &cur[(r + 2) * w];
+            for (uint32_t x = 0; x < w; x++)
+            {
+                demon_t* pd = &part->demons[r * w + x];
+                uint8_t neighbours[4] = {above[x], below[x], here[x ? x - 1 : w - 1], here[(x + 1 < w) ? x + 1 : 0]};
+                for (int n = 0; n < 4; n++)
+                {
+                    if ((neighbours[n] & HABITAT_SICK) && 0 == demonRand(pd) % HABITAT_CONTAGION_ODDS)
+                    {
+                        enqueueEvt(pd, EVT_GOT_SICK_RANDOMLY);
+                        part->contagions++;
+                    }
+                    if ((neighbours[n] & ~HABITAT_SICK) && 0 == demonRand(pd) % HABITAT_POOP_ODDS)
+                    {
+                        enqueueEvt(pd, EVT_GOT_SICK_POOP);
+                        part->poopSick++;
+                    }
+                }
+
+                runTicks(pd, h->policy, 1);
+
+                // The dead are replaced, so the population stays the same size
+                if (pd->health <= 0)
+                {
+                    resetDemon(pd, mixSeed(mixSeed(h->seed, t + 1), (uint64_t)(part->firstRow + r) * w + x));
+                    part->births++;
+                }
+                next[(r + 1) * w + x] = habitatExposure(pd);
+            }
+        }
+
+        // Nobody reads the next grid until every band has finished this tick
+        habitatPushHalos(part, (t + 1) & 1);
+        pthread_barrier_wait(&h->barrier);
+    }
+
+    for (uint32_t i = 0; i < part->numRows * w; i++)
+    {
+        part->sick += part->demons[i].isSick;
+        part->check += part->demons[i].rng;
+        releaseDemon(&part->demons[i]);
+    }
+    free(part->exposure[1]);
+    free(part->exposure[0]);
+    free(part->demons);
+    return NULL;
+}
+
+/**
+ * @brief Run a habitat for a number of ticks, split into bands of rows over a
+ * number of threads
+ *
+ * @param h       The habitat, with its size, ticks, policy and seed set
+ * @param threads The number of threads, at most one per row
+ * @param total   Where to add up the bands' counts
+ * @return The time taken, in seconds
+ */
+static double habitatRun(habitat_t* h, uint32_t threads, habitatPart_t* total)
+{
+    h->numParts = (threads < h->height) ? threads : h->height;
+    h->parts = calloc(h->numParts, sizeof(habitatPart_t));
+    pthread_barrier_init(&h->barrier, NULL, h->numParts);
+
+    uint32_t row = 0;
+    for (uint32_t i = 0; i < h->numParts; i++)
+    {
+        habitatPart_t* part = &h->parts[i];
+        part->habitat = h;
+        part->index = i;
+        part->firstRow = row;
+        part->numRows = h->height / h->numParts + (i < h->height % h->numParts);
+        row += part->numRows;
+    }
+
+    double start = nowSeconds();
+    for (uint32_t i = 0; i < h->numParts; i++)
+    {
+        pthread_create(&h->parts[i].thread, NULL, habitatWorker, &h->parts[i]);
+    }
+    memset(total, 0, sizeof(*total));
+    for (uint32_t i = 0; i < h->numParts; i++)
+    {
+        pthread_join(h->parts[i].thread, NULL);
+        total->births += h->parts[i].births;
+        total->contagions += h->parts[i].contagions;
+        total->poopSick += h->parts[i].poopSick;
+        total->sick += h->parts[i].sick;
+        total->check += h->parts[i].check;
+    }
+    double elapsed = nowSeconds() - start;
+
+    pthread_barrier_destroy(&h->barrier);
+    free(h->parts);
+    h->parts = NULL;
+    return elapsed;
+}
+
+/**
+ * @brief Simulate shared habitats, where demons catch sickness from sick
+ * neighbours and get sick from their neighbours' poop, and report the ticks
+ * per second at a few population sizes up to the number of lifetimes. The
+ * largest habitat is run again on one thread, to measure the speedup and to
+ * check that splitting it doesn't change the results
+ *
+ * @param opts The command line options
+ * @return 0 if the split and unsplit runs matched, 1 if not
+ */
+int runHabitat(const options_t* opts)
+{
+    // Lookahead runs its own threads for each decision
+    uint32_t threads = (POLICY_MCTS == opts->policy) ? 1 : (opts->threads ? opts->threads : numCores());
+
+    printf("habitat: %s, %u ticks, seed %u, %u threads, a sick neighbour infects 1 in %d, poop 1 in %d\n\n",
+           policyNames[opts->policy], opts->habitatTicks, opts->seed, threads, HABITAT_CONTAGION_ODDS,
+           HABITAT_POOP_ODDS);
+    printf("%10s %6s %6s %9s %10s %12s %6s %10s %11s %10s\n", "population", "side", "bands", "seconds", "ticks/s",
+           "demon-ticks/s", "sick", "deaths/t", "contagion/t", "poop/t");
+
+    int ret = 0;
+    uint32_t largest = 0;
+    uint32_t largestBands = 0;
+    double largestElapsed = 0;
+    habitatPart_t largestTotal;
+    memset(&largestTotal, 0, sizeof(largestTotal));
+    for (int size = HABITAT_SIZES - 1; size >= 0; size--)
+    {
+        uint32_t side = (uint32_t)sqrt((double)opts->lifetimes / (1u << (2 * size)));
+        if ((uint64_t)side * side < HABITAT_MIN_POPULATION && size > 0)
+        {
+            continue;
+        }
+        side = (side < 2) ? 2 : side;
+
+        habitat_t h =
+        {
+            .width = side,
+            .height = side,
+            .ticks = opts->habitatTicks,
+            .policy = opts->policy,
+            .seed = opts->seed,
+        };
+        habitatPart_t total;
+        double elapsed = habitatRun(&h, threads, &total);
+        double population = (double)side * side;
+        double ticks = (h.ticks > 0) ? h.ticks : 1;
+        printf("%10.0f %6u %6u %9.3f %10.1f %12.3g %5.1f%% %10.1f %11.1f %10.1f\n", population, side, h.numParts,
+               elapsed, h.ticks / elapsed, population * h.ticks / elapsed, 100 * total.sick / population,
+               total.births / ticks, total.contagions / ticks, total.poopSick / ticks);
+        fflush(stdout);
+
+        // Populations only grow, so the last one run is the largest
+        largest = side;
+        largestBands = h.numParts;
+        largestElapsed = elapsed;
+        largestTotal = total;
+    }
+
+    // Splitting into bands must not change anything, and should pay for itself
+    if (threads > 1 && largest > 1)
+    {
+        habitat_t h =
+        {
+            .width = largest,
+            .height = largest,
+            .ticks = opts->habitatTicks,
+            .policy = opts->policy,
+            .seed = opts->seed,
+        };
+        habitatPart_t total;
+        double elapsed = habitatRun(&h, 1, &total);
+        bool same = total.births == largestTotal.births && total.contagions == largestTotal.contagions &&
+                    total.poopSick == largestTotal.poopSick && total.sick == largestTotal.sick &&
+                    total.check == largestTotal.check;
+        printf("\n%u demons: %.1f ticks/s on 1 thread, %.1f on %u, %.2fx speedup\n", largest * largest,
+               h.ticks / elapsed, h.ticks / largestElapsed, threads, elapsed / largestElapsed);
+        printf("%u bands give %s results to one\n", largestBands, same ? "identical" : "DIFFERENT");
+        ret = same ? 0 : 1;
+    }
+    return ret;
+}
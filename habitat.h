@@ -0,0 +1,16 @@
+#ifndef _HABITAT_H_
+#define _HABITAT_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+int runHabitat(const options_t* opts);
+
+#endif
@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "live.h"
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Get the size of a segment with some slots
+ *
+ * @param numSlots The number of slots
+ * @return The size in bytes
+ */
+static size_t liveSize(uint32_t numSlots)
+{
+    return sizeof(liveShared_t) + numSlots * sizeof(liveSlot_t);
+}
+
+/**
+ * @brief Check if a name's segment was left behind by a run that died without
+ * finishing. Anything that isn't a live stats segment is never stale
+ *
+ * @param name The POSIX shared memory name
+ * @return true if it's safe to remove
+ */
+static bool liveStale(const char* name)
+{
+    liveShared_t* live = liveAttach(name);
+    if (NULL == live)
+    {
+        return false;
+    }
+    bool stale = (0 != kill((pid_t)live->pid, 0) && ESRCH == errno);
+    liveDetach(live);
+    return stale;
+}
+
+/**
+ * @brief Create a shared memory segment for a run's live stats. A name in use
+ * by a running simulation is refused rather than truncated under it
+ *
+ * @param name           The POSIX shared memory name, e.g. /demon
+ * @param numSlots       One slot per worker thread
+ * @param totalLifetimes The lifetimes the run will simulate
+ * @param policy         The policy's name
+ * @param statNames      DSTAT_NUM_STATS stat names
+ * @param evtNames       EVT_NUM_EVENTS event names
+ * @param startTime      When the run started, in nowSeconds() time
+ * @return The segment, NULL if it couldn't be created, with errno EEXIST if
+ *         the name is in use
+ */
+liveShared_t* liveCreate(const char* name, uint32_t numSlots, uint64_t totalLifetimes, const char* policy,
+                         const char* const* statNames, const char* const* evtNames, double startTime)
+{
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 && EEXIST == errno)
+    {
+        if (!liveStale(name))
+        {
+            errno = EEXIST;
+            return NULL;
+        }
+        shm_unlink(name);
+        fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    size_t size = liveSize(numSlots);
+    liveShared_t* live = MAP_FAILED;
+    if (0 == ftruncate(fd, size))
+    {
+        live = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (MAP_FAILED == live)
+    {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate zero filled the slots
+    live->version = LIVE_VERSION;
+    live->numSlots = numSlots;
+    live->pid = getpid();
+    live->totalLifetimes = totalLifetimes;
+    live->startTime = startTime;
+    snprintf(live->policy, LIVE_NAME_LEN, "%s", policy);
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        snprintf(live->statNames[s], LIVE_NAME_LEN, "%s", statNames[s]);
+    }
+    for (int e = 0; e < EVT_NUM_EVENTS; e++)
+    {
+        snprintf(live->evtNames[e], LIVE_NAME_LEN, "%s", evtNames[e]);
+    }
+    atomic_init(&live->state, LIVE_RUNNING);
+
+    // The magic goes in last, so a viewer never sees a half written header
+    atomic_thread_fence(memory_order_release);
+    live->magic = LIVE_MAGIC;
+    return live;
+}
+
+/**
+ * @brief Mark a run's segment done and remove its name. Viewers which are
+ * already attached keep their mapping and see the final totals
+ *
+ * @param live The segment, may be NULL
+ * @param name The name it was created with
+ */
+void liveFinish(liveShared_t* live, const char* name)
+{
+    if (NULL == live)
+    {
+        return;
+    }
+    atomic_store_explicit(&live->state, LIVE_DONE, memory_order_release);
+    shm_unlink(name);
+    munmap(live, liveSize(live->numSlots));
+}
+
+/**
+ * @brief Attach to a running simulation's segment, read only
+ *
+ * @param name The name it was created with
+ * @return The segment, NULL if there isn't one or it isn't a live stats segment
+ */
+liveShared_t* liveAttach(const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    liveShared_t* live = MAP_FAILED;
+    if (0 == fstat(fd, &st) && st.st_size >= (off_t)sizeof(liveShared_t))
+    {
+        live = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (MAP_FAILED == live)
+    {
+        return NULL;
+    }
+
+    if (LIVE_MAGIC != live->magic || LIVE_VERSION != live->version ||
+        (off_t)liveSize(live->numSlots) > st.st_size)
+    {
+        munmap(live, st.st_size);
+        return NULL;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    return live;
+}
+
+/**
+ * @brief Detach from a segment
+ *
+ * @param live The segment from liveAttach()
+ */
+void liveDetach(liveShared_t* live)
+{
+    munmap(live, liveSize(live->numSlots));
+}
+
+/**
+ * @brief Publish a worker's running totals. Only the slot's own worker may
+ * call this, and it never waits for readers
+ *
+ * @param slot      The worker's slot
+ * @param base      What the slot held before this worker took it over, so
+ *                  totals carry on across batches
+ * @param lifetimes Lifetimes the worker has finished
+ * @param sum       DSTAT_NUM_STATS sums of its dead demons' stats
+ * @param evtCount  EVT_NUM_EVENTS counts of its events
+ */
+void livePublish(liveSlot_t* slot, const liveTotals_t* base, uint64_t lifetimes, const int64_t* sum,
+                 const uint64_t* evtCount)
+{
+    // An odd seq marks the slot as being written
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->lifetimes, base->lifetimes + lifetimes, memory_order_relaxed);
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        atomic_store_explicit(&slot->sum[s], base->sum[s] + sum[s], memory_order_relaxed);
+    }
+    for (int e = 0; e < EVT_NUM_EVENTS; e++)
+    {
+        atomic_store_explicit(&slot->evtCount[e], base->evtCount[e] + evtCount[e], memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Read one worker's totals consistently, retrying while it's publishing
+ *
+ * @param slot   The worker's slot
+ * @param totals Where to store its totals
+ */
+void liveReadSlot(const liveSlot_t* slot, liveTotals_t* totals)
+{
+    // The segment may be mapped read only, but atomic loads want a non-const pointer
+    liveSlot_t* s = (liveSlot_t*)slot;
+    unsigned before;
+    unsigned after;
+    do
+    {
+        before = atomic_load_explicit(&s->seq, memory_order_acquire);
+        totals->lifetimes = atomic_load_explicit(&s->lifetimes, memory_order_relaxed);
+        for (int i = 0; i < DSTAT_NUM_STATS; i++)
+        {
+            totals->sum[i] = atomic_load_explicit(&s->sum[i], memory_order_relaxed);
+        }
+        for (int e = 0; e < EVT_NUM_EVENTS; e++)
+        {
+            totals->evtCount[e] = atomic_load_explicit(&s->evtCount[e], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+/**
+ * @brief Read the totals of every worker
+ *
+ * @param live   The segment
+ * @param totals Where to store the totals
+ */
+void liveRead(const liveShared_t* live, liveTotals_t* totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    for (uint32_t i = 0; i < live->numSlots; i++)
+    {
+        liveTotals_t copy;
+        liveReadSlot(&live->slots[i], &copy);
+        totals->lifetimes += copy.lifetimes;
+        for (int s = 0; s < DSTAT_NUM_STATS; s++)
+        {
+            totals->sum[s] += copy.sum[s];
+        }
+        for (int e = 0; e < EVT_NUM_EVENTS; e++)
+        {
+            totals->evtCount[e] += copy.evtCount[e];
+        }
+    }
+}
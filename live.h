@@ -0,0 +1,91 @@
+#ifndef _LIVE_H_
+#define _LIVE_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <stdatomic.h>
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define LIVE_MAGIC     0x4556494C ///< "LIVE"
+#define LIVE_VERSION   1
+#define LIVE_NAME_LEN  32
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+typedef enum
+{
+    LIVE_RUNNING,
+    LIVE_DONE,
+    LIVE_NUM_STATES,
+} liveState_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/**
+ * One worker's running totals, guarded by a seqlock. Only the worker writes
+ * it, so publishing never waits. A reader retries if seq was odd or changed
+ * while it copied the totals. The fields are relaxed atomics so the racing
+ * reads are well defined, which costs nothing extra on x86
+ */
+typedef struct
+{
+    atomic_uint seq;
+    _Atomic uint64_t lifetimes;
+    _Atomic int64_t sum[DSTAT_NUM_STATS];
+    _Atomic uint64_t evtCount[EVT_NUM_EVENTS];
+} __attribute__((aligned(64))) liveSlot_t;
+
+/// A consistent copy of one or more slots
+typedef struct
+{
+    uint64_t lifetimes;
+    int64_t sum[DSTAT_NUM_STATS];
+    uint64_t evtCount[EVT_NUM_EVENTS];
+} liveTotals_t;
+
+/**
+ * The shared memory segment of a run. Everything but the slots and state is
+ * written before the segment is published, and names are copied in so the
+ * viewer doesn't need the simulator's tables
+ */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t pid;
+    uint64_t totalLifetimes;
+    double startTime;       ///< CLOCK_MONOTONIC seconds, which every process shares
+    char policy[LIVE_NAME_LEN];
+    char statNames[DSTAT_NUM_STATS][LIVE_NAME_LEN];
+    char evtNames[EVT_NUM_EVENTS][LIVE_NAME_LEN];
+    atomic_uint state;      ///< A liveState_t
+    liveSlot_t slots[];
+} liveShared_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+liveShared_t* liveCreate(const char* name, uint32_t numSlots, uint64_t totalLifetimes, const char* policy,
+                         const char* const* statNames, const char* const* evtNames, double startTime);
+void liveFinish(liveShared_t* live, const char* name);
+liveShared_t* liveAttach(const char* name);
+void liveDetach(liveShared_t* live);
+void livePublish(liveSlot_t* slot, const liveTotals_t* base, uint64_t lifetimes, const int64_t* sum,
+                 const uint64_t* evtCount);
+void liveReadSlot(const liveSlot_t* slot, liveTotals_t* totals);
+void liveRead(const liveShared_t* live, liveTotals_t* totals);
+
+#endif
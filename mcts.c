@@ -0,0 +1,272 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "mcts.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+// Rollout scores are fixed point so sums don't depend on the order threads finish in
+#define MCTS_SURVIVAL_SCORE 1000 ///< Score for surviving the whole horizon
+#define MCTS_HEALTH_WEIGHT    20 ///< Score per point of health at the end of the horizon
+#define MCTS_HAPPY_WEIGHT      5 ///< Score per point of happiness at the end of the horizon
+#define MCTS_HAPPY_CLAMP      20 ///< Happiness beyond this doesn't count for more
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// A pool of worker threads which run rollouts for one decision at a time
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+    pthread_t* threads;
+    uint32_t numThreads;
+    uint32_t generation;  ///< Incremented for every decision
+    uint32_t workersBusy; ///< Workers still running rollouts for this decision
+    bool quit;
+
+    // Settings
+    uint32_t rolloutsPerAction;
+    uint32_t decisionMs;
+    uint32_t horizon;
+
+    // The current decision
+    demon_t root;
+    uint64_t seed;
+    double deadline;      ///< 0 for no deadline
+    atomic_uint nextRollout;
+    int64_t scoreSum[MCTS_NUM_ACTIONS];
+    uint32_t rolloutCount[MCTS_NUM_ACTIONS];
+} mctsPool_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+static mctsPool_t pool;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Fork a demon, take one action, then let the heuristic policy play for
+ * the rest of the horizon
+ *
+ * @param root    The demon to fork
+ * @param action  The index of the first action, 0 to MCTS_NUM_ACTIONS - 1
+ * @param seed    The seed for the fork's own RNG
+ * @param horizon The number of ticks to look ahead
+ * @return The fixed point score of the rollout
+ */
+static int64_t mctsRollout(const demon_t* root, uint32_t action, uint64_t seed, uint32_t horizon)
+{
+    // The demon owns its queue and RNG, so a copy is a fork
+    demon_t fork;
+    copyDemon(&fork, root);
+    fork.rng = seed;
+
+    stepDemon(&fork, '1' + action);
+    uint32_t ticks = 1 + runTicks(&fork, POLICY_HEURISTIC, horizon - 1);
+    releaseDemon(&fork);
+
+    if (fork.health <= 0)
+    {
+        // The tick the demon died in doesn't count as survived
+        return (int64_t)(ticks - 1) * MCTS_SURVIVAL_SCORE / horizon;
+    }
+
+    int32_t happy = fork.happy;
+    if (happy > MCTS_HAPPY_CLAMP)
+    {
+        happy = MCTS_HAPPY_CLAMP;
+    }
+    else if (happy < -MCTS_HAPPY_CLAMP)
+    {
+        happy = -MCTS_HAPPY_CLAMP;
+    }
+    return MCTS_SURVIVAL_SCORE + MCTS_HEALTH_WEIGHT * fork.health + MCTS_HAPPY_WEIGHT * happy;
+}
+
+/**
+ * @brief Worker thread. Waits for a decision, then claims and runs rollouts
+ * until the rollout budget or the deadline is used up
+ *
+ * @param arg unused
+ * @return NULL
+ */
+static void* mctsWorker(void* arg)
+{
+    (void)arg;
+    autoMode = true;
+
+    uint32_t seenGeneration = 0;
+    pthread_mutex_lock(&pool.lock);
+    while (true)
+    {
+        while (!pool.quit && pool.generation == seenGeneration)
+        {
+            pthread_cond_wait(&pool.workReady, &pool.lock);
+        }
+        if (pool.quit)
+        {
+            break;
+        }
+        seenGeneration = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        // Rollouts are numbered, and the number picks both the action and the RNG stream
+        int64_t scoreSum[MCTS_NUM_ACTIONS] = {0};
+        uint32_t rolloutCount[MCTS_NUM_ACTIONS] = {0};
+        uint32_t totalRollouts = pool.rolloutsPerAction ? pool.rolloutsPerAction * MCTS_NUM_ACTIONS : UINT32_MAX;
+        while (true)
+        {
+            uint32_t r = atomic_fetch_add(&pool.nextRollout, 1);
+            if (r >= totalRollouts || (pool.deadline > 0 && nowSeconds() >= pool.deadline))
+            {
+                break;
+            }
+            uint32_t action = r % MCTS_NUM_ACTIONS;
+            scoreSum[action] += mctsRollout(&pool.root, action, mixSeed(pool.seed, r / MCTS_NUM_ACTIONS), pool.horizon);
+            rolloutCount[action]++;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+        {
+            pool.scoreSum[a] += scoreSum[a];
+            pool.rolloutCount[a] += rolloutCount[a];
+        }
+        if (0 == --pool.workersBusy)
+        {
+            pthread_cond_signal(&pool.workDone);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/**
+ * @brief Start the rollout worker threads
+ *
+ * @param threads           The number of worker threads
+ * @param rolloutsPerAction Rollouts per action per decision, 0 for no limit
+ * @param decisionMs        Time per decision, 0 for no limit
+ * @param horizon           Ticks per rollout
+ */
+void mctsInit(uint32_t threads, uint32_t rolloutsPerAction, uint32_t decisionMs, uint32_t horizon)
+{
+    memset(&pool, 0, sizeof(pool));
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.workReady, NULL);
+    pthread_cond_init(&pool.workDone, NULL);
+    pool.rolloutsPerAction = rolloutsPerAction;
+    pool.decisionMs = decisionMs;
+    pool.horizon = horizon;
+
+    pool.numThreads = threads;
+    pool.threads = calloc(threads, sizeof(pthread_t));
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        pthread_create(&pool.threads[t], NULL, mctsWorker, NULL);
+    }
+}
+
+/**
+ * @brief Stop the rollout worker threads, if they were started
+ */
+void mctsDeinit(void)
+{
+    if (NULL == pool.threads)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = true;
+    pthread_cond_broadcast(&pool.workReady);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (uint32_t t = 0; t < pool.numThreads; t++)
+    {
+        pthread_join(pool.threads[t], NULL);
+    }
+    free(pool.threads);
+    pool.threads = NULL;
+    releaseDemon(&pool.root);
+
+    pthread_cond_destroy(&pool.workDone);
+    pthread_cond_destroy(&pool.workReady);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+/**
+ * @brief Score every action by the mean of its rollouts, using all the worker
+ * threads. Scores are roughly 0 for dying right away to 1 for surviving the
+ * horizon, plus a bit for remaining health and plus or minus a bit for happiness
+ *
+ * @param pd     The demon to look ahead from
+ * @param seed   The seed the rollouts' RNG streams are derived from
+ * @param scores Where to store each action's score
+ */
+void mctsEvaluate(const demon_t* pd, uint64_t seed, double scores[MCTS_NUM_ACTIONS])
+{
+    pthread_mutex_lock(&pool.lock);
+    releaseDemon(&pool.root);
+    copyDemon(&pool.root, pd);
+    pool.seed = seed;
+    pool.deadline = pool.decisionMs ? nowSeconds() + pool.decisionMs / 1000.0 : 0;
+    atomic_store(&pool.nextRollout, 0);
+    memset(pool.scoreSum, 0, sizeof(pool.scoreSum));
+    memset(pool.rolloutCount, 0, sizeof(pool.rolloutCount));
+    pool.workersBusy = pool.numThreads;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.workReady);
+
+    while (pool.workersBusy > 0)
+    {
+        pthread_cond_wait(&pool.workDone, &pool.lock);
+    }
+
+    for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+    {
+        scores[a] = pool.rolloutCount[a] ?
+                    pool.scoreSum[a] / (double)(pool.rolloutCount[a] * (int64_t)MCTS_SURVIVAL_SCORE) : 0;
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/**
+ * @brief Pick the action with the best expected survival and happiness
+ *
+ * @param pd The demon. Its RNG seeds the rollouts, so decisions are repeatable
+ * @return The menu character for the action
+ */
+char mctsGetInput(demon_t* pd)
+{
+    double scores[MCTS_NUM_ACTIONS];
+    uint64_t seed = ((uint64_t)demonRand(pd) << 32) | (uint32_t)demonRand(pd);
+    mctsEvaluate(pd, seed, scores);
+
+    // Ties go to the heuristic policy's pick, which the rollouts follow anyway
+    demon_t tmp;
+    copyDemon(&tmp, pd);
+    int best = getAutoInput(&tmp, POLICY_HEURISTIC) - '1';
+    releaseDemon(&tmp);
+    for (int a = 0; a < MCTS_NUM_ACTIONS; a++)
+    {
+        if (scores[a] > scores[best])
+        {
+            best = a;
+        }
+    }
+    return '1' + best;
+}
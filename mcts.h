@@ -0,0 +1,25 @@
+#ifndef _MCTS_H_
+#define _MCTS_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define MCTS_NUM_ACTIONS 5 ///< Feed, play, discipline, medicine, scoop
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void mctsInit(uint32_t threads, uint32_t rolloutsPerAction, uint32_t decisionMs, uint32_t horizon);
+void mctsDeinit(void);
+void mctsEvaluate(const demon_t* pd, uint64_t seed, double scores[MCTS_NUM_ACTIONS]);
+char mctsGetInput(demon_t* pd);
+
+#endif
@@ -0,0 +1,602 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "profile.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define PROFILE_CHUNK 256 ///< Lifetimes a worker claims at a time
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+/// The parts of a tick, plus the reset between lifetimes
+typedef enum
+{
+    PHASE_RESET,
+    PHASE_DECIDE,
+    PHASE_ACTION,
+    PHASE_UPDATE,
+    PHASE_NUM_PHASES
+} profPhase_t;
+
+/// The hardware counters each phase is measured with
+typedef enum
+{
+    PCTR_CYCLES,
+    PCTR_INSTRUCTIONS,
+    PCTR_BRANCH_MISSES,
+    PCTR_CACHE_MISSES,
+    PCTR_NUM_COUNTERS
+} profCounter_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// One thread's counters for one phase, counting together as a perf group
+typedef struct
+{
+    int leader;                 ///< The group's first counter, -1 if none could be opened
+    int fds[PCTR_NUM_COUNTERS]; ///< -1 for counters which aren't available
+} profGroup_t;
+
+/// What a phase, or whole lifetimes, cost one thread
+typedef struct
+{
+    uint64_t count[PCTR_NUM_COUNTERS];
+    uint64_t ns; ///< Only timed when there are no counters
+} profTally_t;
+
+/// One pass over the lifetimes, shared out between worker threads
+typedef struct
+{
+    atomic_uint nextChunk;
+    uint32_t numLifetimes;
+    policy_t policy;
+    uint64_t seed;
+    bool phases;                        ///< Measure each phase with the generic loop, not whole lifetimes
+    bool available[PCTR_NUM_COUNTERS];  ///< Counters which opened when probed
+} profJob_t;
+
+/// A worker thread and what it measured
+typedef struct
+{
+    profJob_t* job;
+    pthread_t thread;
+    uint64_t lifetimes;
+    uint64_t ticks;
+    uint64_t check;   ///< Sum of every demon's final RNG state, to compare the passes
+    double seconds;
+    profTally_t tally[PHASE_NUM_PHASES]; ///< Whole lifetimes go in the first
+    evqHeap_t heap;   ///< Heap event queue traffic, timed in the phase pass
+} profThread_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+static const char* phaseNames[PHASE_NUM_PHASES] =
+{
+    "reset",
+    "decide",
+    "action",
+    "update",
+};
+
+static const char* counterNames[PCTR_NUM_COUNTERS] =
+{
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "cache-misses",
+};
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Open a hardware counter for the calling thread, on any CPU. It only
+ * counts user space, and starts disabled unless it joins a group
+ *
+ * @param counter The counter
+ * @param groupFd The group's leader, or -1 to start a group
+ * @return The counter's file descriptor, or -1 with errno set
+ */
+static int profOpenCounter(profCounter_t counter, int groupFd)
+{
+#ifdef __linux__
+    static const uint64_t configs[PCTR_NUM_COUNTERS] =
+    {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[counter];
+    attr.disabled = (-1 == groupFd);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0);
+#else
+    (void)counter;
+    (void)groupFd;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/**
+ * @brief Find which counters this machine has, printing why any are missing
+ *
+ * @param available Where to store whether each counter opened
+ * @return true if any counter is available
+ */
+static bool profProbe(bool available[PCTR_NUM_COUNTERS])
+{
+    bool any = false;
+    int lastErrno = 0;
+    for (int c = 0; c < PCTR_NUM_COUNTERS; c++)
+    {
+        int fd = profOpenCounter(c, -1);
+        available[c] = (fd >= 0);
+        if (fd >= 0)
+        {
+            close(fd);
+            any = true;
+        }
+        else
+        {
+            lastErrno = errno;
+            printf("%s: unavailable (%s)\n", counterNames[c], strerror(errno));
+        }
+    }
+
+    if (!any)
+    {
+        printf("No hardware counters, so phases are timed with the clock instead\n");
+        if (EACCES == lastErrno || EPERM == lastErrno)
+        {
+            printf("  /proc/sys/kernel/perf_event_paranoid must be 2 or lower, or run with CAP_PERFMON\n");
+        }
+        else if (ENOENT == lastErrno || EOPNOTSUPP == lastErrno || ENODEV == lastErrno)
+        {
+            printf("  The CPU exposes no counters, as in many virtual machines\n");
+        }
+        else if (ENOSYS == lastErrno)
+        {
+            printf("  perf counters need Linux\n");
+        }
+    }
+    return any;
+}
+
+/**
+ * @brief Open one group of the available counters for the calling thread
+ *
+ * @param group     Where to store the group
+ * @param available Which counters to open
+ */
+static void profGroupOpen(profGroup_t* group, const bool available[PCTR_NUM_COUNTERS])
+{
+    group->leader = -1;
+    for (int c = 0; c < PCTR_NUM_COUNTERS; c++)
+    {
+        group->fds[c] = available[c] ? profOpenCounter(c, group->leader) : -1;
+        if (-1 == group->leader)
+        {
+            group->leader = group->fds[c];
+        }
+    }
+}
+
+/**
+ * @brief Add up a group's counts, scaled up if the kernel had to multiplex it,
+ * then close it
+ *
+ * @param group The group
+ * @param tally Where to add the counts
+ */
+static void profGroupClose(profGroup_t* group, profTally_t* tally)
+{
+    if (-1 == group->leader)
+    {
+        return;
+    }
+
+    // The number of counters, time enabled and time running, then each counter in the order opened
+    uint64_t values[3 + PCTR_NUM_COUNTERS];
+    if (read(group->leader, values, sizeof(values)) >= (ssize_t)(3 * sizeof(uint64_t)))
+    {
+        double scale = (values[2] > 0 && values[2] < values[1]) ? values[1] / (double)values[2] : 1;
+        uint64_t k = 0;
+        for (int c = 0; c < PCTR_NUM_COUNTERS; c++)
+        {
+            if (group->fds[c] >= 0 && k < values[0])
+            {
+                tally->count[c] += (uint64_t)(values[3 + k++] * scale);
+            }
+        }
+    }
+
+    for (int c = PCTR_NUM_COUNTERS - 1; c >= 0; c--)
+    {
+        if (group->fds[c] >= 0)
+        {
+            close(group->fds[c]);
+        }
+    }
+    group->leader = -1;
+}
+
+/**
+ * @brief Get a monotonic timestamp
+ *
+ * @return The time in nanoseconds
+ */
+static inline uint64_t profNowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Start measuring a phase, with its counters if there are any or the
+ * clock if not
+ *
+ * @param group The phase's counters
+ * @return The start time, when timing with the clock
+ */
+static inline uint64_t profBegin(const profGroup_t* group)
+{
+    if (-1 == group->leader)
+    {
+        return profNowNs();
+    }
+#ifdef __linux__
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    return 0;
+}
+
+/**
+ * @brief Stop measuring a phase
+ *
+ * @param group The phase's counters
+ * @param tally Where to add the time, when timing with the clock
+ * @param start What profBegin() returned
+ */
+static inline void profEnd(const profGroup_t* group, profTally_t* tally, uint64_t start)
+{
+    if (-1 == group->leader)
+    {
+        tally->ns += profNowNs() - start;
+        return;
+    }
+#ifdef __linux__
+    ioctl(group->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+/**
+ * @brief Profile worker thread. Claims chunks of lifetimes until there are
+ * none left. Whole lifetimes run in the stage kernels, exactly like auto mode,
+ * while phases run in the equivalent generic loop so each can be measured on
+ * its own
+ *
+ * @param arg The profThread_t
+ * @return NULL
+ */
+static void* profWorker(void* arg)
+{
+    profThread_t* pt = arg;
+    profJob_t* job = pt->job;
+    autoMode = true;
+
+    // Counters are per thread, so each worker opens its own
+    profGroup_t groups[PHASE_NUM_PHASES];
+    int numGroups = job->phases ? PHASE_NUM_PHASES : 1;
+    for (int g = 0; g < numGroups; g++)
+    {
+        profGroupOpen(&groups[g], job->available);
+    }
+
+    // Long lives spill the event queue to the heap, time that inside the phases too
+    memset(&evqHeap, 0, sizeof(evqHeap));
+    evqHeap.timed = job->phases;
+
+    double start = nowSeconds();
+    uint32_t chunk;
+    while ((chunk = atomic_fetch_add(&job->nextChunk, 1)) < (job->numLifetimes + PROFILE_CHUNK - 1) / PROFILE_CHUNK)
+    {
+        uint32_t end = (chunk + 1) * PROFILE_CHUNK;
+        if (end > job->numLifetimes)
+        {
+            end = job->numLifetimes;
+        }
+        for (uint32_t i = chunk * PROFILE_CHUNK; i < end; i++)
+        {
+            demon_t pd;
+            memset(evtCtr, 0, sizeof(evtCtr));
+            if (!job->phases)
+            {
+                uint64_t t = profBegin(&groups[0]);
+                resetDemon(&pd, mixSeed(job->seed, i));
+                pt->ticks += runTicks(&pd, job->policy, UINT32_MAX);
+                profEnd(&groups[0], &pt->tally[0], t);
+            }
+            else
+            {
+                uint64_t t = profBegin(&groups[PHASE_RESET]);
+                resetDemon(&pd, mixSeed(job->seed, i));
+                profEnd(&groups[PHASE_RESET], &pt->tally[PHASE_RESET], t);
+                while (pd.health > 0)
+                {
+                    t = profBegin(&groups[PHASE_DECIDE]);
+                    char action = getAutoInput(&pd, job->policy);
+                    profEnd(&groups[PHASE_DECIDE], &pt->tally[PHASE_DECIDE], t);
+
+                    t = profBegin(&groups[PHASE_ACTION]);
+                    doAction(&pd, action);
+                    profEnd(&groups[PHASE_ACTION], &pt->tally[PHASE_ACTION], t);
+
+                    t = profBegin(&groups[PHASE_UPDATE]);
+                    updateStatus(&pd);
+                    profEnd(&groups[PHASE_UPDATE], &pt->tally[PHASE_UPDATE], t);
+                    pt->ticks++;
+                }
+            }
+            pt->lifetimes++;
+            pt->check += pd.rng;
+        }
+    }
+    pt->seconds = nowSeconds() - start;
+    pt->heap = evqHeap;
+    evqHeap.timed = false;
+
+    for (int g = 0; g < numGroups; g++)
+    {
+        profGroupClose(&groups[g], &pt->tally[g]);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Run every lifetime once over a number of threads
+ *
+ * @param job     The pass
+ * @param threads Where to store each thread's measurements
+ * @param numThreads The number of threads
+ */
+static void profRunPass(profJob_t* job, profThread_t* threads, uint32_t numThreads)
+{
+    atomic_init(&job->nextChunk, 0);
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        memset(&threads[t], 0, sizeof(profThread_t));
+        threads[t].job = job;
+        pthread_create(&threads[t].thread, NULL, profWorker, &threads[t]);
+    }
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        pthread_join(threads[t].thread, NULL);
+    }
+}
+
+/**
+ * @brief Print a ratio, or a dash if its counter isn't available
+ *
+ * @param available Whether the counter is available
+ * @param num       The numerator
+ * @param den       The denominator
+ * @param width     The column's width
+ * @param precision Digits after the point
+ */
+static void profPrintRatio(bool available, double num, double den, int width, int precision)
+{
+    if (available && den > 0)
+    {
+        printf(" %*.*f", width, precision, num / den);
+    }
+    else
+    {
+        printf(" %*s", width, "-");
+    }
+}
+
+/**
+ * @brief Print a row's per tick and per lifetime ratios
+ *
+ * @param tally     What the row cost
+ * @param ticks     The ticks it ran
+ * @param lifetimes The lifetimes it ran
+ * @param available Which counters are available
+ * @param counters  false if the clock was used instead
+ */
+static void profPrintRatios(const profTally_t* tally, uint64_t ticks, uint64_t lifetimes,
+                            const bool available[PCTR_NUM_COUNTERS], bool counters)
+{
+    if (!counters)
+    {
+        profPrintRatio(true, tally->ns, ticks, 10, 2);
+        profPrintRatio(true, tally->ns, lifetimes, 12, 0);
+        printf("\n");
+        return;
+    }
+    profPrintRatio(available[PCTR_CYCLES], tally->count[PCTR_CYCLES], ticks, 11, 1);
+    profPrintRatio(available[PCTR_INSTRUCTIONS], tally->count[PCTR_INSTRUCTIONS], ticks, 10, 1);
+    profPrintRatio(available[PCTR_CYCLES] && available[PCTR_INSTRUCTIONS], tally->count[PCTR_INSTRUCTIONS],
+                   tally->count[PCTR_CYCLES], 5, 2);
+    profPrintRatio(available[PCTR_BRANCH_MISSES], tally->count[PCTR_BRANCH_MISSES], ticks, 11, 4);
+    profPrintRatio(available[PCTR_CACHE_MISSES], tally->count[PCTR_CACHE_MISSES], ticks, 10, 4);
+    profPrintRatio(available[PCTR_CYCLES], tally->count[PCTR_CYCLES], lifetimes, 12, 0);
+    printf("\n");
+}
+
+/**
+ * @brief Print the ratios' header
+ *
+ * @param first    The first columns' header
+ * @param counters false if the clock was used instead
+ */
+static void profPrintHeader(const char* first, bool counters)
+{
+    if (counters)
+    {
+        printf("%s %11s %10s %5s %11s %10s %12s\n", first, "cycles/tick", "instr/tick", "IPC", "brmiss/tick",
+               "cmiss/tick", "cycles/life");
+    }
+    else
+    {
+        printf("%s %10s %12s\n", first, "ns/tick", "ns/life");
+    }
+}
+
+/**
+ * @brief Profile the simulator with hardware counters. Whole lifetimes are
+ * counted per thread in the stage kernels auto mode uses, then each phase of a
+ * tick is counted separately in the generic loop. Switching counters between
+ * phases costs two system calls, so the phases run slower than the kernels and
+ * are best read as shares. Without counters, e.g. in a VM or with perf events
+ * forbidden, the same passes are timed with the clock. Heap event queue
+ * allocations are counted in both passes and timed in the phase pass
+ *
+ * @param opts The command line options
+ * @return 0
+ */
+int runProfile(const options_t* opts)
+{
+    // Lookahead runs its own threads for each decision
+    uint32_t numThreads = (POLICY_MCTS == opts->policy) ? 1 : (opts->threads ? opts->threads : numCores());
+    profThread_t* whole = calloc(numThreads, sizeof(profThread_t));
+    profThread_t* phases = calloc(numThreads, sizeof(profThread_t));
+
+    profJob_t job =
+    {
+        .numLifetimes = opts->lifetimes,
+        .policy = opts->policy,
+        .seed = opts->seed,
+    };
+    bool counters = profProbe(job.available);
+    printf("profile: %s, %u lifetimes, seed %u, %u threads\n\n", policyNames[opts->policy], opts->lifetimes,
+           opts->seed, numThreads);
+
+    job.phases = false;
+    profRunPass(&job, whole, numThreads);
+    job.phases = true;
+    profRunPass(&job, phases, numThreads);
+
+    // Whole lifetimes, per thread
+    printf("whole lifetimes, stage kernels\n");
+    profPrintHeader("thread lifetimes      ticks    ticks/s", counters);
+    profThread_t all;
+    memset(&all, 0, sizeof(all));
+    for (uint32_t t = 0; t <= numThreads; t++)
+    {
+        const profThread_t* pt = (t < numThreads) ? &whole[t] : &all;
+        if (t < numThreads)
+        {
+            printf("%6u", t);
+            all.lifetimes += pt->lifetimes;
+            all.ticks += pt->ticks;
+            all.check += pt->check;
+            all.seconds = fmax(all.seconds, pt->seconds);
+            all.tally[0].ns += pt->tally[0].ns;
+            for (int c = 0; c < PCTR_NUM_COUNTERS; c++)
+            {
+                all.tally[0].count[c] += pt->tally[0].count[c];
+            }
+        }
+        else
+        {
+            printf("%6s", "all");
+        }
+        printf(" %9llu %10llu %10.0f", (unsigned long long)pt->lifetimes, (unsigned long long)pt->ticks,
+               pt->seconds > 0 ? pt->ticks / pt->seconds : 0);
+        profPrintRatios(&pt->tally[0], pt->ticks, pt->lifetimes, job.available, counters);
+    }
+
+    // Each phase, summed over the threads
+    profTally_t phaseTally[PHASE_NUM_PHASES];
+    profTally_t total;
+    uint64_t phaseTicks = 0;
+    uint64_t phaseCheck = 0;
+    memset(phaseTally, 0, sizeof(phaseTally));
+    memset(&total, 0, sizeof(total));
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        phaseTicks += phases[t].ticks;
+        phaseCheck += phases[t].check;
+        for (int p = 0; p < PHASE_NUM_PHASES; p++)
+        {
+            phaseTally[p].ns += phases[t].tally[p].ns;
+            total.ns += phases[t].tally[p].ns;
+            for (int c = 0; c < PCTR_NUM_COUNTERS; c++)
+            {
+                phaseTally[p].count[c] += phases[t].tally[p].count[c];
+                total.count[c] += phases[t].tally[p].count[c];
+            }
+        }
+    }
+
+    printf("\nphases, generic loop, summed over threads\n");
+    profPrintHeader("phase   share", counters);
+    for (int p = 0; p <= PHASE_NUM_PHASES; p++)
+    {
+        const profTally_t* tally = (p < PHASE_NUM_PHASES) ? &phaseTally[p] : &total;
+        double part = counters ? tally->count[PCTR_CYCLES] : tally->ns;
+        double sum = counters ? total.count[PCTR_CYCLES] : total.ns;
+        printf("%-6s %5.1f%%", (p < PHASE_NUM_PHASES) ? phaseNames[p] : "total", sum > 0 ? 100 * part / sum : 0);
+        profPrintRatios(tally, phaseTicks, all.lifetimes, job.available, counters);
+    }
+    // Allocation isn't a phase of its own, it happens inside action and update
+    evqHeap_t heap;
+    double phaseSeconds = 0;
+    uint64_t kernelAllocs = 0;
+    memset(&heap, 0, sizeof(heap));
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        kernelAllocs += whole[t].heap.allocs;
+        heap.allocs += phases[t].heap.allocs;
+        heap.frees += phases[t].heap.frees;
+        heap.seconds += phases[t].heap.seconds;
+        phaseSeconds += phases[t].seconds;
+    }
+    printf("\nheap event queue: %llu allocations, %.3f per 1000 ticks", (unsigned long long)kernelAllocs,
+           all.ticks > 0 ? 1000.0 * kernelAllocs / all.ticks : 0);
+    if (heap.allocs + heap.frees > 0)
+    {
+        printf(", %.0f ns per allocation or free with the clock reads, %.2f%% of the phase time",
+               1e9 * heap.seconds / (heap.allocs + heap.frees), phaseSeconds > 0 ? 100 * heap.seconds / phaseSeconds : 0);
+    }
+    printf("\n");
+
+    printf("\nthe generic loop %s the stage kernels\n",
+           (phaseTicks == all.ticks && phaseCheck == all.check) ? "matches" : "DOES NOT MATCH");
+
+    free(phases);
+    free(whole);
+    return 0;
+}
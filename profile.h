@@ -0,0 +1,16 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+int runProfile(const options_t* opts);
+
+#endif
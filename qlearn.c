@@ -0,0 +1,422 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "qlearn.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define QL_NUM_ACTIONS 5 ///< Feed, play, discipline, medicine, scoop
+
+// The discretized state. Each stat is bucketed where the rules change behavior
+#define QL_HUNGER_BUCKETS     5 ///< obese, full, perfect, hungry, malnourished
+#define QL_HAPPY_BUCKETS      5 ///< positive, 0, -1, -2, -3 or less
+#define QL_DISCIPLINE_BUCKETS 5 ///< 0 or more, -1, -2, -3, -4 or less
+#define QL_POOP_BUCKETS       5 ///< 0 through 4 or more
+#define QL_SICK_BUCKETS       2
+#define QL_STOMACH_BUCKETS    (STOMACH_SIZE + 1) ///< Number of foods being digested
+#define QL_NUM_STATES (QL_HUNGER_BUCKETS * QL_HAPPY_BUCKETS * QL_DISCIPLINE_BUCKETS * QL_POOP_BUCKETS * \
+                       QL_SICK_BUCKETS * AGE_NUM_AGES * QL_STOMACH_BUCKETS)
+
+// Q values are fixed point so they can be updated with lock free atomic adds
+#define QL_SCALE 1024
+
+#define QL_ALPHA        0.02f  ///< Learning rate
+#define QL_GAMMA        0.99f ///< Discount per tick
+#define QL_EPSILON_MIN  0.05f ///< Exploration rate at the end of training
+#define QL_EPSILON_DECAY 0.5f ///< Fraction of training over which exploration decays to the minimum
+
+// Reward shaping per tick
+#define QL_REWARD_ALIVE     1.0f   ///< For surviving a tick
+#define QL_REWARD_DEATH   -10.0f   ///< For dying
+#define QL_REWARD_HEALTH    0.5f   ///< Per point of health gained (or lost)
+#define QL_REWARD_HAPPY     0.05f  ///< For being happy, or against being unhappy
+
+#define QL_MAX_TICKS    4096 ///< Episodes are cut off after this many ticks
+#define QL_CURVE_POINTS 20   ///< Number of points on the learning curve
+
+#define QL_FILE_MAGIC   0x31545144 ///< "DQT1"
+#define QL_FILE_VERSION 2
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// Header of an exported Q-table, followed by QL_NUM_STATES * QL_NUM_ACTIONS int32_t
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numStates;
+    uint32_t numActions;
+    uint32_t scale;
+    uint32_t config; ///< configId() of the build which trained it
+} qtableHeader_t;
+
+/// Shared state for the training threads
+typedef struct
+{
+    const options_t* opts;
+    atomic_uint nextEpisode;
+    atomic_ullong ticks;
+    atomic_ullong curveActions[QL_CURVE_POINTS];
+    atomic_llong curveReturn[QL_CURVE_POINTS]; ///< Fixed point, QL_SCALE
+    atomic_uint curveCount[QL_CURVE_POINTS];
+} qlTrainer_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+/// The Q-table, shared lock free by every training thread
+static _Atomic int32_t* qtable = NULL;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Discretize a demon's state into a Q-table row
+ *
+ * @param pd The demon
+ * @return The state index, less than QL_NUM_STATES
+ */
+static uint32_t qlStateIndex(const demon_t* pd)
+{
+    uint32_t hunger;
+    if (pd->hunger < OBESE_THRESHOLD)
+    {
+        hunger = 0;
+    }
+    else if (pd->hunger < 0)
+    {
+        hunger = 1;
+    }
+    else if (pd->hunger == 0)
+    {
+        hunger = 2;
+    }
+    else if (pd->hunger <= MALNOURISHED_THRESHOLD)
+    {
+        hunger = 3;
+    }
+    else
+    {
+        hunger = 4;
+    }
+
+    uint32_t happy = (pd->happy > 0) ? 0 : ((pd->happy < -3) ? 4 : (uint32_t)(1 - pd->happy));
+    uint32_t discipline = (pd->discipline >= 0) ? 0 : ((pd->discipline < -4) ? 4 : (uint32_t)(-pd->discipline));
+    uint32_t poop = (pd->poopCount > 4) ? 4 : (uint32_t)(pd->poopCount < 0 ? 0 : pd->poopCount);
+
+    // Count the foods being digested by folding each nibble onto its low bit
+    uint32_t foods = __builtin_popcount((pd->stomach | (pd->stomach >> 1) | (pd->stomach >> 2) |
+                                         (pd->stomach >> 3)) & STOMACH_NIBBLE_LSBS);
+
+    uint32_t idx = hunger;
+    idx = idx * QL_HAPPY_BUCKETS + happy;
+    idx = idx * QL_DISCIPLINE_BUCKETS + discipline;
+    idx = idx * QL_POOP_BUCKETS + poop;
+    idx = idx * QL_SICK_BUCKETS + (pd->isSick ? 1 : 0);
+    idx = idx * AGE_NUM_AGES + pd->age;
+    idx = idx * QL_STOMACH_BUCKETS + foods;
+    return idx;
+}
+
+/**
+ * @brief Find the best action for a state
+ *
+ * @param state    The state index
+ * @param fallback The action to pick if every action ties, e.g. an unvisited state
+ * @return The best action, 0 to QL_NUM_ACTIONS - 1
+ */
+static uint32_t qlBestAction(uint32_t state, uint32_t fallback)
+{
+    _Atomic int32_t* row = &qtable[state * QL_NUM_ACTIONS];
+    uint32_t best = fallback;
+    int32_t bestQ = atomic_load_explicit(&row[fallback], memory_order_relaxed);
+    for (uint32_t a = 0; a < QL_NUM_ACTIONS; a++)
+    {
+        int32_t q = atomic_load_explicit(&row[a], memory_order_relaxed);
+        if (q > bestQ)
+        {
+            best = a;
+            bestQ = q;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Shape the reward for one tick
+ *
+ * @param healthBefore The demon's health before the tick
+ * @param after        The demon after the tick
+ * @return The reward
+ */
+static float qlReward(int8_t healthBefore, const demon_t* after)
+{
+    if (after->health <= 0)
+    {
+        return QL_REWARD_DEATH;
+    }
+
+    float reward = QL_REWARD_ALIVE + QL_REWARD_HEALTH * (after->health - healthBefore);
+    if (after->happy > 0)
+    {
+        reward += QL_REWARD_HAPPY;
+    }
+    else if (after->happy < 0)
+    {
+        reward -= QL_REWARD_HAPPY;
+    }
+    return reward;
+}
+
+/**
+ * @brief Training thread. Claims episodes until all have been run, and
+ * updates the shared Q-table with Q-learning as it goes
+ *
+ * @param arg The qlTrainer_t
+ * @return NULL
+ */
+static void* qlTrainWorker(void* arg)
+{
+    qlTrainer_t* trainer = arg;
+    const options_t* opts = trainer->opts;
+    autoMode = true;
+
+    uint32_t episode;
+    while ((episode = atomic_fetch_add(&trainer->nextEpisode, 1)) < opts->lifetimes)
+    {
+        // Exploration decays linearly, then stays at the minimum
+        float epsilon = 1.0f - episode / (QL_EPSILON_DECAY * opts->lifetimes);
+        if (epsilon < QL_EPSILON_MIN)
+        {
+            epsilon = QL_EPSILON_MIN;
+        }
+
+        // The demon's RNG drives the game, a separate one drives exploration
+        demon_t pd;
+        resetDemon(&pd, mixSeed(opts->seed, episode));
+        uint64_t explore = mixSeed(~(uint64_t)opts->seed, episode);
+
+        float episodeReturn = 0;
+        uint32_t ticks = 0;
+        uint32_t state = qlStateIndex(&pd);
+        while (pd.health > 0 && ticks < QL_MAX_TICKS)
+        {
+            uint32_t action;
+            if (rngNext(&explore) < epsilon * INT32_MAX)
+            {
+                action = rngNext(&explore) % QL_NUM_ACTIONS;
+            }
+            else
+            {
+                action = qlBestAction(state, getAutoInput(&pd, POLICY_HEURISTIC) - '1');
+            }
+
+            int8_t healthBefore = pd.health;
+            stepDemon(&pd, '1' + action);
+            ticks++;
+            float reward = qlReward(healthBefore, &pd);
+            episodeReturn += reward;
+
+            // Q(s, a) += alpha * (r + gamma * max Q(s', a') - Q(s, a)), dead demons have no future
+            uint32_t nextState = qlStateIndex(&pd);
+            float target = reward;
+            if (pd.health > 0)
+            {
+                uint32_t nextBest = qlBestAction(nextState, 0);
+                target += QL_GAMMA * atomic_load_explicit(&qtable[nextState * QL_NUM_ACTIONS + nextBest],
+                          memory_order_relaxed) / (float)QL_SCALE;
+            }
+            _Atomic int32_t* q = &qtable[state * QL_NUM_ACTIONS + action];
+            float current = atomic_load_explicit(q, memory_order_relaxed) / (float)QL_SCALE;
+            atomic_fetch_add_explicit(q, (int32_t)lrintf(QL_ALPHA * (target - current) * QL_SCALE),
+                                      memory_order_relaxed);
+            state = nextState;
+        }
+        releaseDemon(&pd);
+
+        // Record the episode on the learning curve
+        uint32_t point = (uint64_t)episode * QL_CURVE_POINTS / opts->lifetimes;
+        atomic_fetch_add(&trainer->ticks, ticks);
+        atomic_fetch_add(&trainer->curveActions[point], pd.actionsTaken);
+        atomic_fetch_add(&trainer->curveReturn[point], (int64_t)lrintf(episodeReturn * QL_SCALE));
+        atomic_fetch_add(&trainer->curveCount[point], 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Write the Q-table to a file
+ *
+ * @param path The file to write
+ * @return true if it was written, false if not
+ */
+static bool qtableSave(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    if (NULL == f)
+    {
+        return false;
+    }
+
+    qtableHeader_t header =
+    {
+        .magic = QL_FILE_MAGIC,
+        .version = QL_FILE_VERSION,
+        .numStates = QL_NUM_STATES,
+        .numActions = QL_NUM_ACTIONS,
+        .scale = QL_SCALE,
+        .config = configId(),
+    };
+    bool ok = (1 == fwrite(&header, sizeof(header), 1, f));
+    for (uint32_t i = 0; ok && i < QL_NUM_STATES * QL_NUM_ACTIONS; i++)
+    {
+        int32_t q = atomic_load(&qtable[i]);
+        ok = (1 == fwrite(&q, sizeof(q), 1, f));
+    }
+    return (0 == fclose(f)) && ok;
+}
+
+/**
+ * @brief Load a Q-table exported by train mode for the qtable policy
+ *
+ * @param path The file to read
+ * @return true if it was loaded, false if it is missing or doesn't match this build
+ */
+bool qtableLoad(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (NULL == f)
+    {
+        return false;
+    }
+
+    qtableHeader_t header;
+    bool ok = (1 == fread(&header, sizeof(header), 1, f)) &&
+              QL_FILE_MAGIC == header.magic &&
+              QL_FILE_VERSION == header.version &&
+              QL_NUM_STATES == header.numStates &&
+              QL_NUM_ACTIONS == header.numActions &&
+              QL_SCALE == header.scale &&
+              configId() == header.config;
+    if (ok)
+    {
+        free((void*)qtable);
+        qtable = calloc(QL_NUM_STATES * QL_NUM_ACTIONS, sizeof(*qtable));
+        for (uint32_t i = 0; ok && i < QL_NUM_STATES * QL_NUM_ACTIONS; i++)
+        {
+            int32_t q;
+            ok = (1 == fread(&q, sizeof(q), 1, f));
+            atomic_init(&qtable[i], q);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+/**
+ * @brief Hash the loaded Q-table (FNV-1a), which defines the qtable policy
+ *
+ * @return The hash, 0 if no table is loaded
+ */
+uint64_t qtableHash(void)
+{
+    if (NULL == qtable)
+    {
+        return 0;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t i = 0; i < QL_NUM_STATES * QL_NUM_ACTIONS; i++)
+    {
+        uint32_t q = atomic_load_explicit(&qtable[i], memory_order_relaxed);
+        for (int b = 0; b < 4; b++)
+        {
+            hash ^= (q >> (8 * b)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief Pick the greedy action from the loaded Q-table. States which were
+ * never visited in training fall back to the heuristic policy, which only
+ * reads the demon
+ *
+ * @param pd The demon
+ * @return The menu character for the action
+ */
+char qtableGetInput(demon_t* pd)
+{
+    uint32_t fallback = getAutoInput(pd, POLICY_HEURISTIC) - '1';
+    return '1' + qlBestAction(qlStateIndex(pd), fallback);
+}
+
+/**
+ * @brief Learn a Q-table from many parallel episodes, print the learning
+ * curve and throughput, then export the table if a path was given
+ *
+ * @param opts The command line options. lifetimes is the number of episodes
+ * @return 0 on success, 1 if the Q-table couldn't be written
+ */
+int qlearnTrain(const options_t* opts)
+{
+    free((void*)qtable);
+    qtable = calloc(QL_NUM_STATES * QL_NUM_ACTIONS, sizeof(*qtable));
+
+    qlTrainer_t trainer;
+    memset(&trainer, 0, sizeof(trainer));
+    trainer.opts = opts;
+
+    uint32_t numThreads = opts->threads ? opts->threads : numCores();
+    pthread_t* threads = calloc(numThreads, sizeof(pthread_t));
+    double start = nowSeconds();
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        pthread_create(&threads[t], NULL, qlTrainWorker, &trainer);
+    }
+    for (uint32_t t = 0; t < numThreads; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    double elapsed = nowSeconds() - start;
+    free(threads);
+
+    printf("%-10s %12s %12s\n", "episodes", "avg actions", "avg return");
+    for (int p = 0; p < QL_CURVE_POINTS; p++)
+    {
+        uint32_t count = atomic_load(&trainer.curveCount[p]);
+        if (count > 0)
+        {
+            printf("%-10u %12.1f %12.1f\n", (uint32_t)((uint64_t)(p + 1) * opts->lifetimes / QL_CURVE_POINTS),
+                   atomic_load(&trainer.curveActions[p]) / (double)count,
+                   atomic_load(&trainer.curveReturn[p]) / (double)QL_SCALE / count);
+        }
+    }
+
+    printf("\n%u episodes on %u threads in %.2fs: %.0f episodes/s, %.0f ticks/s\n", opts->lifetimes, numThreads,
+           elapsed, opts->lifetimes / elapsed, atomic_load(&trainer.ticks) / elapsed);
+
+    if (NULL != opts->qtablePath)
+    {
+        if (qtableSave(opts->qtablePath))
+        {
+            printf("Q-table written to %s\n", opts->qtablePath);
+        }
+        else
+        {
+            printf("Couldn't write Q-table to %s\n", opts->qtablePath);
+            return 1;
+        }
+    }
+    return 0;
+}
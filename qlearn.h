@@ -0,0 +1,19 @@
+#ifndef _QLEARN_H_
+#define _QLEARN_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+int qlearnTrain(const options_t* opts);
+bool qtableLoad(const char* path);
+uint64_t qtableHash(void);
+char qtableGetInput(demon_t* pd);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _REGRESS_H_
+#define _REGRESS_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+int runRegression(const options_t* opts);
+
+#endif
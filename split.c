@@ -0,0 +1,320 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "split.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define SPLIT_MAX_LEVELS 64
+#define SPLIT_LEVEL_STEP 50 ///< Actions between levels past adulthood
+#define SPLIT_REPLICATIONS 8 ///< Independent runs, whose spread gives the standard error
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// One level's worth of trajectories, shared out between worker threads
+typedef struct
+{
+    const options_t* opts;
+    demon_t* starters;     ///< The demons starting this level
+    bool* reached;         ///< Set for each starter that reaches the level alive
+    uint32_t numStarters;
+    int32_t level;         ///< The actionsTaken to reach
+    bool lastLevel;        ///< The rare outcome is checked on the last level
+    atomic_uint next;
+    atomic_ullong ticks;
+} splitLevel_t;
+
+/// The levels and buffers every replication shares, and what they add up to
+typedef struct
+{
+    const options_t* opts;
+    const int32_t* levels;
+    int numLevels;
+    uint32_t numThreads;
+    demon_t* starters;
+    demon_t* survivors;
+    bool* reached;
+    pthread_t* threads;
+    uint64_t levelStarted[SPLIT_MAX_LEVELS]; ///< Demons starting each level, over every replication
+    uint64_t levelReached[SPLIT_MAX_LEVELS]; ///< Demons reaching it
+    uint64_t ticks;
+} splitRun_t;
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Check if a demon that just reached the last level has the rare outcome
+ *
+ * @param opts The command line options, which pick the outcome
+ * @param pd   The demon
+ * @return true if it has the outcome
+ */
+static bool splitOutcome(const options_t* opts, const demon_t* pd)
+{
+    switch (opts->splitEvent)
+    {
+        case SPLIT_ADULT_DISCIPLINED:
+        {
+            return pd->health > 0 && AGE_ADULT == pd->age && pd->discipline > 0;
+        }
+        default:
+        case SPLIT_SURVIVE:
+        {
+            return pd->health > 0;
+        }
+    }
+}
+
+/**
+ * @brief Worker thread. Runs each claimed starter until it dies or reaches the level
+ *
+ * @param arg The splitLevel_t
+ * @return NULL
+ */
+static void* splitWorker(void* arg)
+{
+    splitLevel_t* lvl = arg;
+    autoMode = true;
+
+    uint32_t i;
+    uint64_t ticks = 0;
+    while ((i = atomic_fetch_add(&lvl->next, 1)) < lvl->numStarters)
+    {
+        // Every action takes exactly one tick, so this stops right at the level
+        demon_t* pd = &lvl->starters[i];
+        ticks += runTicks(pd, lvl->opts->policy, lvl->level - pd->actionsTaken);
+        lvl->reached[i] = lvl->lastLevel ? splitOutcome(lvl->opts, pd) : (pd->health > 0);
+    }
+    atomic_fetch_add(&lvl->ticks, ticks);
+    return NULL;
+}
+
+/**
+ * @brief Run plain Monte Carlo lifetimes for the rare outcome until a tick
+ * budget is spent, to compare against splitting
+ *
+ * @param opts       The command line options
+ * @param levels     The levels, the last one is where the outcome is checked
+ * @param numLevels  The number of levels
+ * @param tickBudget Ticks to spend
+ * @param lifetimes  Where to store the number of lifetimes run
+ * @return The number of lifetimes with the rare outcome
+ */
+static uint64_t splitPlainMonteCarlo(const options_t* opts, const int32_t* levels, int numLevels,
+                                     uint64_t tickBudget, uint64_t* lifetimes)
+{
+    uint64_t ticks = 0;
+    uint64_t hits = 0;
+    *lifetimes = 0;
+    while (ticks < tickBudget)
+    {
+        demon_t pd;
+        resetDemon(&pd, mixSeed(~(uint64_t)opts->seed, *lifetimes));
+        ticks += runTicks(&pd, opts->policy, levels[numLevels - 1]);
+        hits += splitOutcome(opts, &pd);
+        releaseDemon(&pd);
+        (*lifetimes)++;
+    }
+    return hits;
+}
+
+/**
+ * @brief Run one replication of fixed effort splitting. At each level -n
+ * trajectories start from clones of the demons which reached it, each clone
+ * with its own RNG stream, and the rest are dropped
+ *
+ * @param run  The levels and buffers
+ * @param seed The replication's seed
+ * @return The product of the fraction reaching each level, an unbiased estimate
+ */
+static double splitReplicate(splitRun_t* run, uint64_t seed)
+{
+    const options_t* opts = run->opts;
+    uint32_t n = opts->lifetimes;
+    demon_t* starters = run->starters;
+    demon_t* survivors = run->survivors;
+
+    // A separate RNG picks which survivors are cloned
+    uint64_t pickRng = mixSeed(seed, UINT32_MAX);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        resetDemon(&starters[i], mixSeed(seed, i));
+    }
+
+    double estimate = 1;
+    for (int l = 0; l < run->numLevels; l++)
+    {
+        splitLevel_t lvl =
+        {
+            .opts = opts,
+            .starters = starters,
+            .reached = run->reached,
+            .numStarters = n,
+            .level = run->levels[l],
+            .lastLevel = (l == run->numLevels - 1),
+        };
+        atomic_init(&lvl.next, 0);
+        atomic_init(&lvl.ticks, 0);
+        for (uint32_t t = 0; t < run->numThreads; t++)
+        {
+            pthread_create(&run->threads[t], NULL, splitWorker, &lvl);
+        }
+        for (uint32_t t = 0; t < run->numThreads; t++)
+        {
+            pthread_join(run->threads[t], NULL);
+        }
+        run->ticks += atomic_load(&lvl.ticks);
+
+        // Keep the demons that made it, in order so results don't depend on threads
+        uint32_t numSurvivors = 0;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (run->reached[i])
+            {
+                survivors[numSurvivors++] = starters[i];
+            }
+            else
+            {
+                releaseDemon(&starters[i]);
+            }
+        }
+
+        estimate *= numSurvivors / (double)n;
+        run->levelStarted[l] += n;
+        run->levelReached[l] += numSurvivors;
+        if (0 == numSurvivors)
+        {
+            break;
+        }
+
+        // Clone random survivors to start the next level, each with a new RNG stream
+        for (uint32_t i = 0; i < n && l + 1 < run->numLevels; i++)
+        {
+            copyDemon(&starters[i], &survivors[rngNext(&pickRng) % numSurvivors]);
+            starters[i].rng = mixSeed(mixSeed(seed, l + 1), i);
+        }
+        for (uint32_t i = 0; i < numSurvivors; i++)
+        {
+            releaseDemon(&survivors[i]);
+        }
+    }
+    return estimate;
+}
+
+/**
+ * @brief Estimate the probability of a rare outcome with fixed effort
+ * multilevel splitting. The levels are action counts: becoming a teen, becoming
+ * an adult, then every SPLIT_LEVEL_STEP actions up to the target. Clones share
+ * ancestors, so the levels aren't independent and the per-level binomial
+ * variances would understate the error. Instead SPLIT_REPLICATIONS independent
+ * replications are run, the estimate is their mean, and the standard error
+ * comes from their spread
+ *
+ * @param opts The command line options
+ * @return 0 on success, 1 for bad options
+ */
+int runSplitting(const options_t* opts)
+{
+    autoMode = true;
+
+    // Pick the levels
+    int32_t levels[SPLIT_MAX_LEVELS];
+    int numLevels = 0;
+    int32_t target = (SPLIT_ADULT_DISCIPLINED == opts->splitEvent) ? ACTIONS_UNTIL_ADULT : opts->splitTarget;
+    if (target > INT16_MAX)
+    {
+        printf("The target can't be more than %d actions\n", INT16_MAX);
+        return 1;
+    }
+    for (int32_t l = ACTIONS_UNTIL_TEEN; l < target && numLevels < SPLIT_MAX_LEVELS - 1;)
+    {
+        levels[numLevels++] = l;
+        l = (l < ACTIONS_UNTIL_ADULT) ? ACTIONS_UNTIL_ADULT : l + SPLIT_LEVEL_STEP;
+    }
+    levels[numLevels++] = target;
+
+    uint32_t n = opts->lifetimes;
+    // Lookahead runs its own threads for each decision, and they only serve one demon at a time
+    uint32_t numThreads = (POLICY_MCTS == opts->policy) ? 1 : (opts->threads ? opts->threads : numCores());
+    splitRun_t run =
+    {
+        .opts = opts,
+        .levels = levels,
+        .numLevels = numLevels,
+        .numThreads = numThreads,
+        .starters = calloc(n, sizeof(demon_t)),
+        .survivors = calloc(n, sizeof(demon_t)),
+        .reached = calloc(n, sizeof(bool)),
+        .threads = calloc(numThreads, sizeof(pthread_t)),
+    };
+
+    // The first replication uses the seed itself, the rest streams derived from it
+    double estimates[SPLIT_REPLICATIONS];
+    double sum = 0;
+    double start = nowSeconds();
+    for (int r = 0; r < SPLIT_REPLICATIONS; r++)
+    {
+        estimates[r] = splitReplicate(&run, (0 == r) ? opts->seed : mixSeed(opts->seed, (uint64_t)UINT32_MAX + r));
+        sum += estimates[r];
+    }
+    double elapsed = nowSeconds() - start;
+
+    printf("%-6s %8s %10s %10s\n", "level", "actions", "reached", "fraction");
+    for (int l = 0; l < numLevels && run.levelStarted[l] > 0; l++)
+    {
+        printf("%-6d %8d %10llu %10.6f\n", l, levels[l], (unsigned long long)run.levelReached[l],
+               run.levelReached[l] / (double)run.levelStarted[l]);
+    }
+
+    double estimate = sum / SPLIT_REPLICATIONS;
+    double sumSq = 0;
+    for (int r = 0; r < SPLIT_REPLICATIONS; r++)
+    {
+        sumSq += (estimates[r] - estimate) * (estimates[r] - estimate);
+    }
+    double stdErr = sqrt(sumSq / (SPLIT_REPLICATIONS - 1) / SPLIT_REPLICATIONS);
+
+    if (SPLIT_ADULT_DISCIPLINED == opts->splitEvent)
+    {
+        printf("\nP(adult with positive discipline)");
+    }
+    else
+    {
+        printf("\nP(survive %d actions)", target);
+    }
+    printf(" = %.3e", estimate);
+    if (estimate > 0)
+    {
+        printf(", standard error %.2e (%.1f%%)", stdErr, 100 * stdErr / estimate);
+    }
+    printf(" over %d replications of %u\n", SPLIT_REPLICATIONS, n);
+    printf("splitting: %llu ticks in %.2fs\n", (unsigned long long)run.ticks, elapsed);
+    if (estimate > 0 && stdErr > 0)
+    {
+        // With this few replications the standard error is itself only good to ~25%
+        printf("plain Monte Carlo needs ~%.3g lifetimes for the same standard error\n",
+               estimate * (1 - estimate) / (stdErr * stdErr));
+    }
+
+    // Show what the same effort buys without splitting
+    uint64_t plainLifetimes;
+    uint64_t hits = splitPlainMonteCarlo(opts, levels, numLevels, run.ticks, &plainLifetimes);
+    printf("plain Monte Carlo with the same ticks: %llu hits in %llu lifetimes, P = %.3e\n",
+           (unsigned long long)hits, (unsigned long long)plainLifetimes, hits / (double)plainLifetimes);
+
+    free(run.threads);
+    free(run.reached);
+    free(run.survivors);
+    free(run.starters);
+    return 0;
+}
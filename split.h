@@ -0,0 +1,16 @@
+#ifndef _SPLIT_H_
+#define _SPLIT_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+int runSplitting(const options_t* opts);
+
+#endif
@@ -0,0 +1,461 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "stats.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define RESULT_FILE_MAGIC   0x53455244 ///< "DRES"
+#define RESULT_FILE_VERSION 3
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+// Each stat's histogram covers STATS_HIST_BINS bins of a width starting at a low value.
+// Values outside are counted in the first or last bin
+static const int32_t histLow[DSTAT_NUM_STATS] =
+{
+    [DSTAT_HUNGER]        = INT8_MIN,
+    [DSTAT_HAPPY]         = -2048,
+    [DSTAT_DISCIPLINE]    = INT8_MIN,
+    [DSTAT_HEALTH]        = INT8_MIN,
+    [DSTAT_POOP_COUNT]    = INT8_MIN,
+    [DSTAT_ACTIONS_TAKEN] = 0,
+};
+static const int32_t histWidth[DSTAT_NUM_STATS] =
+{
+    [DSTAT_HUNGER]        = 1,
+    [DSTAT_HAPPY]         = 16,
+    [DSTAT_DISCIPLINE]    = 1,
+    [DSTAT_HEALTH]        = 1,
+    [DSTAT_POOP_COUNT]    = 1,
+    [DSTAT_ACTIONS_TAKEN] = 8,
+};
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Clear a batch's stats
+ *
+ * @param stats The stats to clear
+ */
+void statsInit(batchStats_t* stats)
+{
+    memset(stats, 0, sizeof(batchStats_t));
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        stats->min[s] = INT32_MAX;
+        stats->max[s] = INT32_MIN;
+    }
+}
+
+/**
+ * @brief Add a dead demon to a batch's stats
+ *
+ * @param stats The stats to add to
+ * @param pd    The dead demon
+ */
+void statsAddDemon(batchStats_t* stats, const demon_t* pd)
+{
+    stats->lifetimes++;
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        int32_t val = getDemonStat(pd, s);
+        stats->sum[s] += val;
+        stats->sumSq[s] += (int64_t)val * val;
+        if (val < stats->min[s])
+        {
+            stats->min[s] = val;
+        }
+        if (val > stats->max[s])
+        {
+            stats->max[s] = val;
+        }
+
+        int32_t bin = (val - histLow[s]) / histWidth[s];
+        if (bin < 0)
+        {
+            bin = 0;
+        }
+        else if (bin >= STATS_HIST_BINS)
+        {
+            bin = STATS_HIST_BINS - 1;
+        }
+        stats->hist[s][bin]++;
+    }
+}
+
+/**
+ * @brief Add one lifetime's event counts, e.g. its thread's evtCtr, to a
+ * batch's stats
+ *
+ * @param stats     The stats to add to
+ * @param evtCounts EVT_NUM_EVENTS event counts
+ */
+void statsAddEvents(batchStats_t* stats, const uint32_t* evtCounts)
+{
+    for (int e = 0; e < EVT_NUM_EVENTS; e++)
+    {
+        stats->evtCount[e] += evtCounts[e];
+        stats->evtSumSq[e] += (uint64_t)evtCounts[e] * evtCounts[e];
+    }
+}
+
+/**
+ * @brief Merge one batch's stats into another's
+ *
+ * @param dst The stats to merge into
+ * @param src The stats to merge from
+ */
+void statsMerge(batchStats_t* dst, const batchStats_t* src)
+{
+    dst->lifetimes += src->lifetimes;
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        dst->sum[s] += src->sum[s];
+        dst->sumSq[s] += src->sumSq[s];
+        if (src->min[s] < dst->min[s])
+        {
+            dst->min[s] = src->min[s];
+        }
+        if (src->max[s] > dst->max[s])
+        {
+            dst->max[s] = src->max[s];
+        }
+        for (int b = 0; b < STATS_HIST_BINS; b++)
+        {
+            dst->hist[s][b] += src->hist[s][b];
+        }
+    }
+    for (int e = 0; e < EVT_NUM_EVENTS; e++)
+    {
+        dst->evtCount[e] += src->evtCount[e];
+        dst->evtSumSq[e] += src->evtSumSq[e];
+    }
+}
+
+/**
+ * @brief Estimate a percentile of a stat from its histogram
+ *
+ * @param stats The stats
+ * @param stat  Which stat
+ * @param pct   The percentile, 0 to 100
+ * @return The low edge of the histogram bin the percentile falls in
+ */
+int32_t statsPercentile(const batchStats_t* stats, demonStat_t stat, double pct)
+{
+    uint64_t target = (uint64_t)ceil(stats->lifetimes * pct / 100.0);
+    uint64_t seen = 0;
+    for (int b = 0; b < STATS_HIST_BINS; b++)
+    {
+        seen += stats->hist[stat][b];
+        if (seen >= target && seen > 0)
+        {
+            return histLow[stat] + b * histWidth[stat];
+        }
+    }
+    return histLow[stat] + (STATS_HIST_BINS - 1) * histWidth[stat];
+}
+
+/**
+ * @brief Print the averages and standard deviations of a batch of dead demons,
+ * the spread of their lifespans, and how often each event happened per demon
+ *
+ * @param stats The batch's stats
+ */
+void printStatsReport(const batchStats_t* stats)
+{
+    if (0 == stats->lifetimes)
+    {
+        printf("No lifetimes\n");
+        return;
+    }
+
+    // Averages are truncated to integers, and the standard deviation is taken around the truncated average
+    int64_t len = stats->lifetimes;
+    printf("             %4s %4s\n", "Avg", "Std");
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        int64_t avg = stats->sum[s] / len;
+        int64_t sqDev = stats->sumSq[s] - 2 * avg * stats->sum[s] + len * avg * avg;
+        int64_t stdev = sqrt(sqDev / len);
+        printf("%-12s %4d %4d\n", demonStatNames[s], (int)avg, (int)stdev);
+    }
+
+    printf("\n");
+    printf("%-12s %5s %5s %5s %5s %5s %5s\n", "lifespan", "min", "p10", "p50", "p90", "p99", "max");
+    printf("%-12s %5d %5d %5d %5d %5d %5d\n", demonStatNames[DSTAT_ACTIONS_TAKEN],
+           stats->min[DSTAT_ACTIONS_TAKEN],
+           statsPercentile(stats, DSTAT_ACTIONS_TAKEN, 10),
+           statsPercentile(stats, DSTAT_ACTIONS_TAKEN, 50),
+           statsPercentile(stats, DSTAT_ACTIONS_TAKEN, 90),
+           statsPercentile(stats, DSTAT_ACTIONS_TAKEN, 99),
+           stats->max[DSTAT_ACTIONS_TAKEN]);
+
+    printf("\n");
+    for (int e = EVT_NONE + 1; e < EVT_NUM_EVENTS; e++)
+    {
+        printf("%-25s %3.2f\n", evtNames[e], stats->evtCount[e] / (float)len);
+    }
+}
+
+/**
+ * @brief Find which lifetimes of a run belong to a shard. Lifetimes are split
+ * as evenly as possible, and every lifetime's seed only depends on its index,
+ * so the shards together simulate exactly the same demons as one run
+ *
+ * @param totalLifetimes The lifetimes in the whole run
+ * @param shardIndex     The shard, 0 to shardCount - 1
+ * @param shardCount     The number of shards
+ * @param first          Where to store the index of the shard's first lifetime
+ * @param count          Where to store the number of lifetimes in the shard
+ */
+void shardRange(uint32_t totalLifetimes, uint32_t shardIndex, uint32_t shardCount, uint32_t* first,
+                uint32_t* count)
+{
+    uint32_t start = (uint64_t)totalLifetimes * shardIndex / shardCount;
+    uint32_t end = (uint64_t)totalLifetimes * (shardIndex + 1) / shardCount;
+    *first = start;
+    *count = end - start;
+}
+
+/**
+ * @brief Write a result file. The file is in native byte order:
+ *   magic, version, then the shardInfo_t fields as uint32_t, config last
+ *   lifetimes as uint64_t
+ *   for each stat: sum, sumSq (int64_t), min, max (int32_t), the number of
+ *     non-empty histogram bins (uint16_t), then each one's index (uint16_t)
+ *     and count (uint64_t)
+ *   the number of events (uint32_t), then each event's count and sum of
+ *     squared per-lifetime counts (uint64_t)
+ *
+ * @param path  The file to write
+ * @param shard Which lifetimes the stats are for
+ * @param stats The stats
+ * @return true if the file was written, false if not
+ */
+bool writeResultFile(const char* path, const shardInfo_t* shard, const batchStats_t* stats)
+{
+    FILE* f = fopen(path, "wb");
+    if (NULL == f)
+    {
+        return false;
+    }
+
+    bool ok = true;
+#define WRITE_VAL(type, val) do{type v = (val); ok = ok && (1 == fwrite(&v, sizeof(v), 1, f));}while(false)
+    WRITE_VAL(uint32_t, RESULT_FILE_MAGIC);
+    WRITE_VAL(uint32_t, RESULT_FILE_VERSION);
+    WRITE_VAL(uint32_t, shard->policy);
+    WRITE_VAL(uint32_t, shard->seed);
+    WRITE_VAL(uint32_t, shard->totalLifetimes);
+    WRITE_VAL(uint32_t, shard->shardIndex);
+    WRITE_VAL(uint32_t, shard->shardCount);
+    WRITE_VAL(uint32_t, shard->first);
+    WRITE_VAL(uint32_t, shard->count);
+    WRITE_VAL(uint32_t, shard->config);
+    WRITE_VAL(uint64_t, stats->lifetimes);
+    for (int s = 0; s < DSTAT_NUM_STATS; s++)
+    {
+        WRITE_VAL(int64_t, stats->sum[s]);
+        WRITE_VAL(int64_t, stats->sumSq[s]);
+        WRITE_VAL(int32_t, stats->min[s]);
+        WRITE_VAL(int32_t, stats->max[s]);
+
+        // Histograms are mostly empty, so only write the bins with counts
+        uint16_t numBins = 0;
+        for (int b = 0; b < STATS_HIST_BINS; b++)
+        {
+            numBins += (stats->hist[s][b] > 0);
+        }
+        WRITE_VAL(uint16_t, numBins);
+        for (int b = 0; b < STATS_HIST_BINS; b++)
+        {
+            if (stats->hist[s][b] > 0)
+            {
+                WRITE_VAL(uint16_t, b);
+                WRITE_VAL(uint64_t, stats->hist[s][b]);
+            }
+        }
+    }
+    WRITE_VAL(uint32_t, EVT_NUM_EVENTS);
+    for (int e = 0; e < EVT_NUM_EVENTS; e++)
+    {
+        WRITE_VAL(uint64_t, stats->evtCount[e]);
+        WRITE_VAL(uint64_t, stats->evtSumSq[e]);
+    }
+#undef WRITE_VAL
+
+    return (0 == fclose(f)) && ok;
+}
+
+/**
+ * @brief Read a result file written by writeResultFile()
+ *
+ * @param path  The file to read
+ * @param shard Where to store which lifetimes the stats are for
+ * @param stats Where to store the stats
+ * @return true if the file was read, false if it is missing, truncated, or a different version
+ */
+bool readResultFile(const char* path, shardInfo_t* shard, batchStats_t* stats)
+{
+    FILE* f = fopen(path, "rb");
+    if (NULL == f)
+    {
+        return false;
+    }
+
+    statsInit(stats);
+    bool ok = true;
+#define READ_VAL(type, dst) do{type v = 0; ok = ok && (1 == fread(&v, sizeof(v), 1, f)); (dst) = v;}while(false)
+    uint32_t magic, version, policy;
+    READ_VAL(uint32_t, magic);
+    READ_VAL(uint32_t, version);
+    ok = ok && (RESULT_FILE_MAGIC == magic) && (RESULT_FILE_VERSION == version);
+    READ_VAL(uint32_t, policy);
+    shard->policy = policy;
+    READ_VAL(uint32_t, shard->seed);
+    READ_VAL(uint32_t, shard->totalLifetimes);
+    READ_VAL(uint32_t, shard->shardIndex);
+    READ_VAL(uint32_t, shard->shardCount);
+    READ_VAL(uint32_t, shard->first);
+    READ_VAL(uint32_t, shard->count);
+    READ_VAL(uint32_t, shard->config);
+    READ_VAL(uint64_t, stats->lifetimes);
+    for (int s = 0; ok && s < DSTAT_NUM_STATS; s++)
+    {
+        READ_VAL(int64_t, stats->sum[s]);
+        READ_VAL(int64_t, stats->sumSq[s]);
+        READ_VAL(int32_t, stats->min[s]);
+        READ_VAL(int32_t, stats->max[s]);
+        uint16_t numBins = 0;
+        READ_VAL(uint16_t, numBins);
+        for (int i = 0; ok && i < numBins; i++)
+        {
+            uint16_t bin = 0;
+            READ_VAL(uint16_t, bin);
+            ok = ok && (bin < STATS_HIST_BINS);
+            if (ok)
+            {
+                READ_VAL(uint64_t, stats->hist[s][bin]);
+            }
+        }
+    }
+    uint32_t numEvents = 0;
+    READ_VAL(uint32_t, numEvents);
+    ok = ok && (EVT_NUM_EVENTS == numEvents);
+    for (int e = 0; ok && e < EVT_NUM_EVENTS; e++)
+    {
+        READ_VAL(uint64_t, stats->evtCount[e]);
+        READ_VAL(uint64_t, stats->evtSumSq[e]);
+    }
+#undef READ_VAL
+
+    fclose(f);
+    return ok && (policy < POLICY_NUM_POLICIES);
+}
+
+/**
+ * @brief Merge shard result files into the report for the whole run. The
+ * shards must all come from the same run, i.e. the same policy, seed, lifetimes
+ * and shard count, built with the same game constants, and no shard may be
+ * given twice
+ *
+ * @param paths    The result files
+ * @param numPaths The number of result files
+ * @return 0 if the report was printed, 1 if the files couldn't be merged
+ */
+int mergeResultFiles(char** paths, int numPaths)
+{
+    if (0 == numPaths)
+    {
+        printf("Nothing to merge\n");
+        return 1;
+    }
+
+    batchStats_t* total = malloc(sizeof(batchStats_t));
+    batchStats_t* part = malloc(sizeof(batchStats_t));
+    statsInit(total);
+    shardInfo_t run = {0};
+    bool* seen = NULL;
+    int ret = 0;
+
+    for (int i = 0; i < numPaths && 0 == ret; i++)
+    {
+        shardInfo_t shard;
+        if (!readResultFile(paths[i], &shard, part))
+        {
+            printf("Couldn't read result file %s\n", paths[i]);
+            ret = 1;
+            break;
+        }
+
+        if (0 == i)
+        {
+            run = shard;
+            seen = calloc(run.shardCount, sizeof(bool));
+        }
+        else if (shard.config != run.config)
+        {
+            printf("%s was simulated with different game constants than %s (config %08x, not %08x)\n", paths[i],
+                   paths[0], shard.config, run.config);
+            ret = 1;
+            break;
+        }
+        else if (shard.policy != run.policy || shard.seed != run.seed ||
+                 shard.totalLifetimes != run.totalLifetimes || shard.shardCount != run.shardCount)
+        {
+            printf("%s is from a different run than %s\n", paths[i], paths[0]);
+            ret = 1;
+            break;
+        }
+
+        uint32_t first, count;
+        shardRange(run.totalLifetimes, shard.shardIndex, run.shardCount, &first, &count);
+        if (shard.shardIndex >= run.shardCount || first != shard.first || count != shard.count ||
+                count != part->lifetimes)
+        {
+            printf("%s has an inconsistent shard range\n", paths[i]);
+            ret = 1;
+        }
+        else if (seen[shard.shardIndex])
+        {
+            printf("Shard %u is given more than once\n", shard.shardIndex);
+            ret = 1;
+        }
+        else
+        {
+            seen[shard.shardIndex] = true;
+            statsMerge(total, part);
+        }
+    }
+
+    if (0 == ret)
+    {
+        uint32_t missing = 0;
+        for (uint32_t k = 0; k < run.shardCount; k++)
+        {
+            if (!seen[k])
+            {
+                printf("Warning: shard %u of %u is missing\n", k, run.shardCount);
+                missing++;
+            }
+        }
+
+        printf("policy %s, seed %u, config %08x, %llu of %u lifetimes from %u of %u shards\n\n",
+               policyNames[run.policy], run.seed, run.config, (unsigned long long)total->lifetimes,
+               run.totalLifetimes, run.shardCount - missing, run.shardCount);
+        printStatsReport(total);
+    }
+
+    free(seen);
+    free(part);
+    free(total);
+    return ret;
+}
@@ -0,0 +1,66 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define STATS_HIST_BINS 256 ///< Histogram bins per stat
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/**
+ * Statistics over a batch of dead demons. Everything is an integer so merging
+ * the stats of several batches gives exactly the stats of one big batch
+ */
+typedef struct
+{
+    uint64_t lifetimes;
+    int64_t sum[DSTAT_NUM_STATS];
+    int64_t sumSq[DSTAT_NUM_STATS];
+    int32_t min[DSTAT_NUM_STATS];
+    int32_t max[DSTAT_NUM_STATS];
+    uint64_t hist[DSTAT_NUM_STATS][STATS_HIST_BINS];
+    uint64_t evtCount[EVT_NUM_EVENTS];
+    uint64_t evtSumSq[EVT_NUM_EVENTS]; ///< Sum over lifetimes of each lifetime's count squared
+} batchStats_t;
+
+/// Which lifetimes of a run a result file holds
+typedef struct
+{
+    policy_t policy;
+    uint32_t seed;
+    uint32_t totalLifetimes; ///< Lifetimes in the whole run, over every shard
+    uint32_t shardIndex;
+    uint32_t shardCount;
+    uint32_t first;          ///< Index of this shard's first lifetime
+    uint32_t count;          ///< Number of lifetimes in this shard
+    uint32_t config;         ///< configId() of the build that simulated them
+} shardInfo_t;
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+void statsInit(batchStats_t* stats);
+void statsAddDemon(batchStats_t* stats, const demon_t* pd);
+void statsAddEvents(batchStats_t* stats, const uint32_t* evtCounts);
+void statsMerge(batchStats_t* dst, const batchStats_t* src);
+int32_t statsPercentile(const batchStats_t* stats, demonStat_t stat, double pct);
+void printStatsReport(const batchStats_t* stats);
+
+void shardRange(uint32_t totalLifetimes, uint32_t shardIndex, uint32_t shardCount, uint32_t* first,
+                uint32_t* count);
+bool writeResultFile(const char* path, const shardInfo_t* shard, const batchStats_t* stats);
+bool readResultFile(const char* path, shardInfo_t* shard, batchStats_t* stats);
+int mergeResultFiles(char** paths, int numPaths);
+
+#endif
@@ -0,0 +1,797 @@
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include <errno.h>
+
+#include "surrogate.h"
+
+/*******************************************************************************
+ * Defines
+ ******************************************************************************/
+
+#define SWEEP_LINE_LEN       4096
+#define SURROGATE_MAX_TERMS  256   ///< Enough for a full quadratic in every game constant
+#define SURROGATE_CANDIDATES 65536 ///< Points considered when picking what to simulate next
+#define SURROGATE_Z975       1.959964 ///< Normal quantile for a two sided 95% interval
+
+/*******************************************************************************
+ * Enums
+ ******************************************************************************/
+
+/// What the surrogate predicts for a set of constants
+typedef enum
+{
+    SOUT_LIFESPAN, ///< Mean actions taken before dying
+    SOUT_HAPPY,    ///< Mean happiness at death
+    SOUT_SICK,     ///< Times falling sick per 100 actions
+    SOUT_NUM_OUTCOMES
+} surOutcome_t;
+
+/*******************************************************************************
+ * Structs
+ ******************************************************************************/
+
+/// The rows of a sweep file with one policy
+typedef struct
+{
+    uint32_t numRows;
+    uint32_t capacity;
+    int32_t* constants; ///< numGameConstants per row
+    double* outcomes;   ///< SOUT_NUM_OUTCOMES per row
+} sweep_t;
+
+/**
+ * A polynomial response surface over the constants that vary in a sweep,
+ * fitted by least squares. Each constant is scaled to [-1, 1] over the range
+ * the sweep covered
+ */
+typedef struct
+{
+    uint32_t numVarying;
+    uint32_t varying[SURROGATE_MAX_TERMS]; ///< Which game constants vary
+    int32_t min[SURROGATE_MAX_TERMS];
+    int32_t max[SURROGATE_MAX_TERMS];
+    bool squared[SURROGATE_MAX_TERMS];     ///< Has a squared term, needs three distinct values
+    bool quadratic;                        ///< Has squared and interaction terms, else only linear
+    uint32_t numTerms;
+    double* inverse;                       ///< (X'X)^-1, numTerms squared
+    double coef[SOUT_NUM_OUTCOMES][SURROGATE_MAX_TERMS];
+    double sigma[SOUT_NUM_OUTCOMES];       ///< Residual standard deviation
+    double t975;                           ///< Student t quantile for sigma's degrees of freedom
+    double looRmse[SOUT_NUM_OUTCOMES];     ///< Leave one out prediction error
+    double r2[SOUT_NUM_OUTCOMES];
+} surModel_t;
+
+/*******************************************************************************
+ * Variables
+ ******************************************************************************/
+
+static const char* outcomeNames[SOUT_NUM_OUTCOMES] =
+{
+    "lifespan",
+    "happy",
+    "sick_per_100",
+};
+
+/// Student t 97.5% quantiles for 1 to 30 degrees of freedom
+static const double tQuantiles975[] =
+{
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+/*******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/**
+ * @brief Write the header a sweep file has with this build's constants
+ *
+ * @param line Where to write it, SWEEP_LINE_LEN long
+ */
+static void sweepHeader(char* line)
+{
+    int len = snprintf(line, SWEEP_LINE_LEN, "config\tpolicy\tseed\tlifetimes");
+    for (uint32_t c = 0; c < numGameConstants; c++)
+    {
+        len += snprintf(&line[len], SWEEP_LINE_LEN - len, "\t%s", gameConstants[c].name);
+    }
+    for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+    {
+        len += snprintf(&line[len], SWEEP_LINE_LEN - len, "\t%s", outcomeNames[o]);
+    }
+    snprintf(&line[len], SWEEP_LINE_LEN - len, "\n");
+}
+
+/**
+ * @brief Add a run's outcomes to a sweep file, with the constants this build
+ * was compiled with. The file is created with a header if it doesn't exist
+ *
+ * @param path   The sweep file
+ * @param stats  The run's stats
+ * @param policy The run's policy
+ * @param seed   The run's seed
+ * @return true if the row was added, false if the file couldn't be written or
+ * has other constants
+ */
+bool sweepAppend(const char* path, const batchStats_t* stats, policy_t policy, uint32_t seed)
+{
+    char header[SWEEP_LINE_LEN];
+    char line[SWEEP_LINE_LEN];
+    sweepHeader(header);
+
+    FILE* f = fopen(path, "r");
+    if (NULL != f)
+    {
+        bool same = (NULL != fgets(line, sizeof(line), f)) && (0 == strcmp(line, header));
+        fclose(f);
+        if (!same)
+        {
+            printf("%s was written by a build with other constants\n", path);
+            return false;
+        }
+        f = fopen(path, "a");
+    }
+    else if (NULL != (f = fopen(path, "w")))
+    {
+        fputs(header, f);
+    }
+    if (NULL == f || 0 == stats->lifetimes)
+    {
+        return false;
+    }
+
+    uint64_t sick = stats->evtCount[EVT_GOT_SICK_RANDOMLY] + stats->evtCount[EVT_GOT_SICK_POOP] +
+                    stats->evtCount[EVT_GOT_SICK_OBESE] + stats->evtCount[EVT_GOT_SICK_MALNOURISHED];
+    fprintf(f, "%08x\t%s\t%u\t%llu", configId(), policyNames[policy], seed, (unsigned long long)stats->lifetimes);
+    for (uint32_t c = 0; c < numGameConstants; c++)
+    {
+        fprintf(f, "\t%d", gameConstants[c].value);
+    }
+    fprintf(f, "\t%.6f\t%.6f\t%.6f\n", stats->sum[DSTAT_ACTIONS_TAKEN] / (double)stats->lifetimes,
+            stats->sum[DSTAT_HAPPY] / (double)stats->lifetimes,
+            stats->sum[DSTAT_ACTIONS_TAKEN] ? 100.0 * sick / stats->sum[DSTAT_ACTIONS_TAKEN] : 0);
+    return 0 == fclose(f);
+}
+
+/**
+ * @brief Read the rows of a sweep file run with one policy
+ *
+ * @param path   The sweep file
+ * @param policy The policy whose rows to keep
+ * @param sweep  Where to store the rows
+ * @return false if the file couldn't be read or has other constants
+ */
+static bool sweepRead(const char* path, policy_t policy, sweep_t* sweep)
+{
+    memset(sweep, 0, sizeof(*sweep));
+    FILE* f = fopen(path, "r");
+    if (NULL == f)
+    {
+        printf("Couldn't read %s\n", path);
+        return false;
+    }
+
+    char header[SWEEP_LINE_LEN];
+    char line[SWEEP_LINE_LEN];
+    sweepHeader(header);
+    if (NULL == fgets(line, sizeof(line), f) || 0 != strcmp(line, header))
+    {
+        printf("%s was written by a build with other constants\n", path);
+        fclose(f);
+        return false;
+    }
+
+    while (NULL != fgets(line, sizeof(line), f))
+    {
+        // Skip the config, check the policy, then skip the seed and lifetimes
+        char* field = strchr(line, '\t');
+        if (NULL == field || 0 != strncmp(field + 1, policyNames[policy], strlen(policyNames[policy])) ||
+            '\t' != field[1 + strlen(policyNames[policy])])
+        {
+            continue;
+        }
+        field += 1 + strlen(policyNames[policy]);
+        strtoul(field, &field, 0);
+        strtoull(field, &field, 0);
+
+        if (sweep->numRows == sweep->capacity)
+        {
+            sweep->capacity = sweep->capacity ? 2 * sweep->capacity : 64;
+            sweep->constants = realloc(sweep->constants, sweep->capacity * numGameConstants * sizeof(int32_t));
+            sweep->outcomes = realloc(sweep->outcomes, sweep->capacity * SOUT_NUM_OUTCOMES * sizeof(double));
+        }
+        int32_t* constants = &sweep->constants[sweep->numRows * numGameConstants];
+        double* outcomes = &sweep->outcomes[sweep->numRows * SOUT_NUM_OUTCOMES];
+        for (uint32_t c = 0; c < numGameConstants; c++)
+        {
+            constants[c] = strtol(field, &field, 10);
+        }
+        for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+        {
+            outcomes[o] = strtod(field, &field);
+        }
+        sweep->numRows++;
+    }
+    fclose(f);
+    if (0 == sweep->numRows)
+    {
+        printf("%s has no %s points\n", path, policyNames[policy]);
+    }
+    return sweep->numRows > 0;
+}
+
+/**
+ * @brief Get a point's terms: a constant, each varying constant scaled to
+ * [-1, 1], then for a quadratic model the squares and pairwise products
+ *
+ * @param model     The model
+ * @param constants Every game constant's value at the point
+ * @param terms     Where to store the terms, model->numTerms long
+ * @return The number of terms
+ */
+static uint32_t surTerms(const surModel_t* model, const int32_t* constants, double* terms)
+{
+    double z[SURROGATE_MAX_TERMS];
+    for (uint32_t v = 0; v < model->numVarying; v++)
+    {
+        double value = constants[model->varying[v]];
+        z[v] = 2 * (value - model->min[v]) / (model->max[v] - model->min[v]) - 1;
+    }
+
+    uint32_t n = 0;
+    terms[n++] = 1;
+    for (uint32_t v = 0; v < model->numVarying; v++)
+    {
+        terms[n++] = z[v];
+    }
+    if (model->quadratic)
+    {
+        for (uint32_t v = 0; v < model->numVarying; v++)
+        {
+            if (model->squared[v])
+            {
+                terms[n++] = z[v] * z[v];
+            }
+        }
+        for (uint32_t v = 0; v < model->numVarying; v++)
+        {
+            for (uint32_t w = v + 1; w < model->numVarying; w++)
+            {
+                terms[n++] = z[v] * z[w];
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief Get the Student t quantile for a two sided 95% interval. Past the
+ * table, a Cornish-Fisher expansion around the normal quantile is good to
+ * better than 1e-4
+ *
+ * @param df The degrees of freedom, at least 1
+ * @return The 97.5% quantile
+ */
+static double surT975(uint32_t df)
+{
+    if (df <= lengthof(tQuantiles975))
+    {
+        return tQuantiles975[df - 1];
+    }
+    double z = SURROGATE_Z975;
+    double z3 = z * z * z;
+    double z5 = z3 * z * z;
+    return z + (z3 + z) / (4.0 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96.0 * df * df);
+}
+
+/**
+ * @brief Get x' A x for a symmetric matrix, the leverage of a point when A is
+ * the model's inverse
+ *
+ * @param a The matrix, n by n
+ * @param x The vector
+ * @param n The size
+ * @return x' A x
+ */
+static double surQuadForm(const double* a, const double* x, uint32_t n)
+{
+    double sum = 0;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        double row = 0;
+        for (uint32_t j = 0; j < n; j++)
+        {
+            row += a[i * n + j] * x[j];
+        }
+        sum += x[i] * row;
+    }
+    return sum;
+}
+
+/**
+ * @brief Invert a symmetric positive definite matrix in place (Gauss-Jordan)
+ *
+ * @param a The matrix, n by n
+ * @param n The size
+ * @return false if it's singular
+ */
+static bool surInvert(double* a, uint32_t n)
+{
+    double* inv = calloc(n * n, sizeof(double));
+    for (uint32_t i = 0; i < n; i++)
+    {
+        inv[i * n + i] = 1;
+    }
+    bool ok = true;
+    for (uint32_t col = 0; col < n && ok; col++)
+    {
+        uint32_t pivot = col;
+        for (uint32_t r = col + 1; r < n; r++)
+        {
+            pivot = (fabs(a[r * n + col]) > fabs(a[pivot * n + col])) ? r : pivot;
+        }
+        ok = fabs(a[pivot * n + col]) > 1e-300;
+        for (uint32_t j = 0; j < n && ok; j++)
+        {
+            double t = a[col * n + j];
+            a[col * n + j] = a[pivot * n + j];
+            a[pivot * n + j] = t;
+            t = inv[col * n + j];
+            inv[col * n + j] = inv[pivot * n + j];
+            inv[pivot * n + j] = t;
+        }
+        double scale = ok ? 1 / a[col * n + col] : 0;
+        for (uint32_t j = 0; j < n && ok; j++)
+        {
+            a[col * n + j] *= scale;
+            inv[col * n + j] *= scale;
+        }
+        for (uint32_t r = 0; r < n && ok; r++)
+        {
+            double factor = a[r * n + col];
+            if (r == col || 0 == factor)
+            {
+                continue;
+            }
+            for (uint32_t j = 0; j < n; j++)
+            {
+                a[r * n + j] -= factor * a[col * n + j];
+                inv[r * n + j] -= factor * inv[col * n + j];
+            }
+        }
+    }
+    memcpy(a, inv, n * n * sizeof(double));
+    free(inv);
+    return ok;
+}
+
+/**
+ * @brief Fit the model to a sweep. A quadratic surface is used when there are
+ * enough rows to leave a couple of degrees of freedom, else a plane. A tiny
+ * ridge keeps the fit stable when the sweep doesn't pin every term down
+ *
+ * @param model Where to store the model
+ * @param sweep The sweep
+ * @return false if the sweep is too small to fit anything
+ */
+static bool surFit(surModel_t* model, const sweep_t* sweep)
+{
+    memset(model, 0, sizeof(*model));
+    for (uint32_t c = 0; c < numGameConstants; c++)
+    {
+        // A squared term needs at least three distinct values to be told apart from the rest
+        int32_t lo = INT32_MAX;
+        int32_t hi = INT32_MIN;
+        int32_t seen[3];
+        uint32_t numSeen = 0;
+        for (uint32_t r = 0; r < sweep->numRows; r++)
+        {
+            int32_t value = sweep->constants[r * numGameConstants + c];
+            bool known = false;
+            for (uint32_t k = 0; k < numSeen; k++)
+            {
+                known = known || (seen[k] == value);
+            }
+            if (!known && numSeen < lengthof(seen))
+            {
+                seen[numSeen++] = value;
+            }
+            lo = (value < lo) ? value : lo;
+            hi = (value > hi) ? value : hi;
+        }
+        if (numSeen >= 2)
+        {
+            model->varying[model->numVarying] = c;
+            model->min[model->numVarying] = lo;
+            model->max[model->numVarying] = hi;
+            model->squared[model->numVarying] = (numSeen >= 3);
+            model->numVarying++;
+        }
+    }
+
+    // Quadratic if the rows allow it, leaving two degrees of freedom for the residuals
+    uint32_t linearTerms = 1 + model->numVarying;
+    uint32_t quadraticTerms = linearTerms + model->numVarying * (model->numVarying - 1) / 2;
+    for (uint32_t v = 0; v < model->numVarying; v++)
+    {
+        quadraticTerms += model->squared[v];
+    }
+    model->quadratic = (sweep->numRows >= quadraticTerms + 2);
+    model->numTerms = model->quadratic ? quadraticTerms : linearTerms;
+    if (0 == model->numVarying || sweep->numRows < linearTerms + 2)
+    {
+        printf("A sweep over %u constants needs at least %u points, this one has %u\n", model->numVarying,
+               linearTerms + 2, sweep->numRows);
+        return false;
+    }
+
+    // Normal equations, X'X and X'y
+    uint32_t p = model->numTerms;
+    uint32_t n = sweep->numRows;
+    double* terms = malloc(n * p * sizeof(double));
+    double xty[SOUT_NUM_OUTCOMES][SURROGATE_MAX_TERMS];
+    memset(xty, 0, sizeof(xty));
+    model->inverse = calloc(p * p, sizeof(double));
+    for (uint32_t r = 0; r < n; r++)
+    {
+        double* x = &terms[r * p];
+        surTerms(model, &sweep->constants[r * numGameConstants], x);
+        for (uint32_t i = 0; i < p; i++)
+        {
+            for (uint32_t j = 0; j < p; j++)
+            {
+                model->inverse[i * p + j] += x[i] * x[j];
+            }
+            for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+            {
+                xty[o][i] += x[i] * sweep->outcomes[r * SOUT_NUM_OUTCOMES + o];
+            }
+        }
+    }
+    double trace = 0;
+    for (uint32_t i = 0; i < p; i++)
+    {
+        trace += model->inverse[i * p + i];
+    }
+    for (uint32_t i = 0; i < p; i++)
+    {
+        model->inverse[i * p + i] += 1e-9 * trace / p;
+    }
+    if (!surInvert(model->inverse, p))
+    {
+        printf("The sweep's points don't determine a model\n");
+        free(terms);
+        free(model->inverse);
+        model->inverse = NULL;
+        return false;
+    }
+
+    for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+    {
+        for (uint32_t i = 0; i < p; i++)
+        {
+            model->coef[o][i] = 0;
+            for (uint32_t j = 0; j < p; j++)
+            {
+                model->coef[o][i] += model->inverse[i * p + j] * xty[o][j];
+            }
+        }
+    }
+
+    // Residuals, and the leave one out residuals from each row's leverage
+    double mean[SOUT_NUM_OUTCOMES] = {0};
+    double rss[SOUT_NUM_OUTCOMES] = {0};
+    double tss[SOUT_NUM_OUTCOMES] = {0};
+    double press[SOUT_NUM_OUTCOMES] = {0};
+    for (uint32_t r = 0; r < n; r++)
+    {
+        for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+        {
+            mean[o] += sweep->outcomes[r * SOUT_NUM_OUTCOMES + o] / n;
+        }
+    }
+    for (uint32_t r = 0; r < n; r++)
+    {
+        const double* x = &terms[r * p];
+        double leverage = fmin(surQuadForm(model->inverse, x, p), 0.999999);
+        for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+        {
+            double fitted = 0;
+            for (uint32_t i = 0; i < p; i++)
+            {
+                fitted += model->coef[o][i] * x[i];
+            }
+            double y = sweep->outcomes[r * SOUT_NUM_OUTCOMES + o];
+            rss[o] += SQUARE(y - fitted);
+            tss[o] += SQUARE(y - mean[o]);
+            press[o] += SQUARE((y - fitted) / (1 - leverage));
+        }
+    }
+    for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+    {
+        model->sigma[o] = sqrt(rss[o] / (n - p));
+        model->looRmse[o] = sqrt(press[o] / n);
+        model->r2[o] = (tss[o] > 0) ? 1 - rss[o] / tss[o] : 1;
+    }
+    model->t975 = surT975(n - p);
+    free(terms);
+    return true;
+}
+
+/**
+ * @brief Predict the outcomes at a point, with a 95% prediction interval for
+ * what simulating it would give. sigma is estimated from the residuals, so
+ * the interval uses the t distribution rather than the normal
+ *
+ * @param model     The model
+ * @param constants Every game constant's value at the point
+ * @param mean      Where to store each outcome's prediction
+ * @param interval  Where to store each outcome's interval half width
+ */
+static void surPredict(const surModel_t* model, const int32_t* constants, double* mean, double* interval)
+{
+    double terms[SURROGATE_MAX_TERMS];
+    uint32_t p = surTerms(model, constants, terms);
+    double leverage = surQuadForm(model->inverse, terms, p);
+    for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+    {
+        mean[o] = 0;
+        for (uint32_t i = 0; i < p; i++)
+        {
+            mean[o] += model->coef[o][i] * terms[i];
+        }
+        interval[o] = model->t975 * model->sigma[o] * sqrt(1 + leverage);
+    }
+}
+
+/**
+ * @brief Print a point's varying constants as build flags
+ *
+ * @param model     The model
+ * @param constants Every game constant's value at the point
+ */
+static void surPrintDefs(const surModel_t* model, const int32_t* constants)
+{
+    printf("DEFS=\"");
+    for (uint32_t v = 0; v < model->numVarying; v++)
+    {
+        printf("%s-D%s=%d", v ? " " : "", gameConstants[model->varying[v]].name, constants[model->varying[v]]);
+    }
+    printf("\"");
+}
+
+/**
+ * @brief Pick the points most worth simulating next. Each pick is the
+ * candidate whose prediction is least certain. The model's inverse is then
+ * updated as if it had been simulated (Sherman-Morrison), which only depends
+ * on where the point is, so the picks spread out rather than cluster.
+ * Candidates are every integer point in the sweep's range, or a sample of
+ * them if there are too many
+ *
+ * @param model The model
+ * @param sweep The sweep, whose points aren't picked again
+ * @param count How many to pick
+ */
+static void surSuggest(const surModel_t* model, const sweep_t* sweep, uint32_t count)
+{
+    uint32_t p = model->numTerms;
+    double* inverse = malloc(p * p * sizeof(double));
+    memcpy(inverse, model->inverse, p * p * sizeof(double));
+
+    // Enumerate the grid if it's small enough, else sample it
+    double gridSize = 1;
+    for (uint32_t v = 0; v < model->numVarying; v++)
+    {
+        gridSize *= model->max[v] - model->min[v] + 1;
+    }
+    uint32_t numCandidates = (gridSize <= SURROGATE_CANDIDATES) ? (uint32_t)gridSize : SURROGATE_CANDIDATES;
+    int32_t* candidates = malloc(numCandidates * numGameConstants * sizeof(int32_t));
+    uint64_t rng = 1;
+    for (uint32_t k = 0; k < numCandidates; k++)
+    {
+        int32_t* constants = &candidates[k * numGameConstants];
+        for (uint32_t c = 0; c < numGameConstants; c++)
+        {
+            constants[c] = sweep->constants[c];
+        }
+        uint32_t index = k;
+        for (uint32_t v = 0; v < model->numVarying; v++)
+        {
+            uint32_t span = model->max[v] - model->min[v] + 1;
+            uint32_t step = (gridSize <= SURROGATE_CANDIDATES) ? index % span : (uint32_t)rngNext(&rng) % span;
+            index /= span;
+            constants[model->varying[v]] = model->min[v] + step;
+        }
+    }
+
+    printf("\nnext points worth simulating, least certain first:\n");
+    bool* skip = calloc(numCandidates, sizeof(bool));
+    for (uint32_t k = 0; k < numCandidates; k++)
+    {
+        for (uint32_t r = 0; r < sweep->numRows && !skip[k]; r++)
+        {
+            skip[k] = (0 == memcmp(&sweep->constants[r * numGameConstants], &candidates[k * numGameConstants],
+                                   numGameConstants * sizeof(int32_t)));
+        }
+    }
+    for (uint32_t pick = 0; pick < count; pick++)
+    {
+        uint32_t best = UINT32_MAX;
+        double bestLeverage = -1;
+        double terms[SURROGATE_MAX_TERMS];
+        for (uint32_t k = 0; k < numCandidates; k++)
+        {
+            if (skip[k])
+            {
+                continue;
+            }
+            surTerms(model, &candidates[k * numGameConstants], terms);
+            double leverage = surQuadForm(inverse, terms, p);
+            if (leverage > bestLeverage)
+            {
+                best = k;
+                bestLeverage = leverage;
+            }
+        }
+        if (UINT32_MAX == best)
+        {
+            printf("  every point in the sweep's range has been simulated\n");
+            break;
+        }
+
+        const int32_t* constants = &candidates[best * numGameConstants];
+        double mean[SOUT_NUM_OUTCOMES];
+        double interval[SOUT_NUM_OUTCOMES];
+        surPredict(model, constants, mean, interval);
+        printf("  ");
+        surPrintDefs(model, constants);
+        printf("  %s %.1f +-%.1f\n", outcomeNames[SOUT_LIFESPAN], mean[SOUT_LIFESPAN], interval[SOUT_LIFESPAN]);
+
+        // As if it had been simulated, so the next pick goes elsewhere
+        double u[SURROGATE_MAX_TERMS];
+        surTerms(model, constants, terms);
+        for (uint32_t i = 0; i < p; i++)
+        {
+            u[i] = 0;
+            for (uint32_t j = 0; j < p; j++)
+            {
+                u[i] += inverse[i * p + j] * terms[j];
+            }
+        }
+        for (uint32_t i = 0; i < p; i++)
+        {
+            for (uint32_t j = 0; j < p; j++)
+            {
+                inverse[i * p + j] -= u[i] * u[j] / (1 + bestLeverage);
+            }
+        }
+        skip[best] = true;
+    }
+
+    free(skip);
+    free(candidates);
+    free(inverse);
+}
+
+/**
+ * @brief Fit a surrogate model to a sweep file's points for one policy, then
+ * predict the outcomes at this build's constants, with any changed on the
+ * command line as NAME=value, and suggest which points to simulate next
+ *
+ * @param opts The command line options, with the sweep file, policy, settings
+ *             and how many points to suggest
+ * @return 0 on success, 1 if the sweep couldn't be read or fitted or a setting
+ * is bad
+ */
+int runSurrogate(const options_t* opts)
+{
+    sweep_t sweep;
+    surModel_t model;
+    if (!sweepRead(opts->sweepPath, opts->policy, &sweep) || !surFit(&model, &sweep))
+    {
+        free(sweep.constants);
+        free(sweep.outcomes);
+        return 1;
+    }
+
+    printf("surrogate: %u %s points in %s, %s over %u constants, %u terms\n", sweep.numRows,
+           policyNames[opts->policy], opts->sweepPath, model.quadratic ? "quadratic" : "linear", model.numVarying,
+           model.numTerms);
+    for (uint32_t v = 0; v < model.numVarying; v++)
+    {
+        printf("  %-40s %d to %d\n", gameConstants[model.varying[v]].name, model.min[v], model.max[v]);
+    }
+    printf("\n%-14s %10s %10s %8s\n", "outcome", "residual", "loo rmse", "R^2");
+    for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+    {
+        printf("%-14s %10.3f %10.3f %8.4f\n", outcomeNames[o], model.sigma[o], model.looRmse[o], model.r2[o]);
+    }
+
+    // Constants the sweep never varied stay at the sweep's values, the rest default to this build's
+    int ret = 0;
+    int32_t* point = malloc(numGameConstants * sizeof(int32_t));
+    memcpy(point, sweep.constants, numGameConstants * sizeof(int32_t));
+    for (uint32_t v = 0; v < model.numVarying; v++)
+    {
+        point[model.varying[v]] = gameConstants[model.varying[v]].value;
+    }
+    for (int i = 0; i < opts->numSettings && 0 == ret; i++)
+    {
+        const char* equals = strchr(opts->settings[i], '=');
+        uint32_t c = 0;
+        while (c < numGameConstants && (strlen(gameConstants[c].name) != (size_t)(equals - opts->settings[i]) ||
+                                        0 != strncmp(gameConstants[c].name, opts->settings[i], equals - opts->settings[i])))
+        {
+            c++;
+        }
+        char* end;
+        errno = 0;
+        long parsed = strtol(equals + 1, &end, 0);
+        int32_t value = (int32_t)parsed;
+        if (c == numGameConstants)
+        {
+            printf("No constant %.*s\n", (int)(equals - opts->settings[i]), opts->settings[i]);
+            ret = 1;
+        }
+        else if (end == equals + 1 || '\0' != *end || ERANGE == errno || parsed < INT32_MIN || parsed > INT32_MAX)
+        {
+            printf("Bad value %s for %s, it should be a 32 bit integer\n", equals + 1, gameConstants[c].name);
+            ret = 1;
+        }
+        else if (value != point[c] && value != sweep.constants[c])
+        {
+            bool varies = false;
+            for (uint32_t v = 0; v < model.numVarying; v++)
+            {
+                varies = varies || (model.varying[v] == c);
+            }
+            if (!varies)
+            {
+                printf("%s is %d at every point in the sweep, so the model can't predict other values\n",
+                       gameConstants[c].name, sweep.constants[c]);
+                ret = 1;
+            }
+        }
+        point[c] = value;
+    }
+
+    if (0 == ret)
+    {
+        bool extrapolating = false;
+        for (uint32_t v = 0; v < model.numVarying; v++)
+        {
+            int32_t value = point[model.varying[v]];
+            extrapolating = extrapolating || value < model.min[v] || value > model.max[v];
+        }
+
+        double mean[SOUT_NUM_OUTCOMES];
+        double interval[SOUT_NUM_OUTCOMES];
+        double start = nowSeconds();
+        uint32_t numPredictions = 0;
+        do
+        {
+            surPredict(&model, point, mean, interval);
+            numPredictions++;
+        } while (numPredictions < 1000 || nowSeconds() - start < 0.05);
+        double perPrediction = (nowSeconds() - start) / numPredictions;
+
+        printf("\nprediction at ");
+        surPrintDefs(&model, point);
+        printf("%s, 95%% interval for a simulated run, %.2f us each\n",
+               extrapolating ? " (extrapolating, outside the sweep)" : "", 1e6 * perPrediction);
+        for (int o = 0; o < SOUT_NUM_OUTCOMES; o++)
+        {
+            printf("  %-14s %10.3f +- %.3f\n", outcomeNames[o], mean[o], interval[o]);
+        }
+        surSuggest(&model, &sweep, opts->suggestions);
+    }
+
+    free(point);
+    free(model.inverse);
+    free(sweep.constants);
+    free(sweep.outcomes);
+    return ret;
+}
@@ -0,0 +1,18 @@
+#ifndef _SURROGATE_H_
+#define _SURROGATE_H_
+
+/*******************************************************************************
+ * Includes
+ ******************************************************************************/
+
+#include "demon.h"
+#include "stats.h"
+
+/*******************************************************************************
+ * Prototypes
+ ******************************************************************************/
+
+bool sweepAppend(const char* path, const batchStats_t* stats, policy_t policy, uint32_t seed);
+int runSurrogate(const options_t* opts);
+
+#endif